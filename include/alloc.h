@@ -0,0 +1,42 @@
+#ifndef ALLOC
+#define ALLOC
+#include <stdlib.h>
+#include <stdatomic.h>
+
+// counted heap allocation. everything the renderer allocates or frees goes through these instead of the c library
+// directly, so a test can check that a stretch of code didn't touch the heap: read alloc_count (or free_count)
+// before and after. the render loop is meant to stay at zero once it's warmed up (see bench_allocations). raylib's
+// own allocations, and the ones the c library makes for itself (threads, stdio), aren't counted. the counters are
+// defined in main.c
+
+extern atomic_long alloc_count; // every Alloc_malloc, Alloc_calloc, Alloc_realloc and Alloc_aligned, and the pages.h mappings
+extern atomic_long free_count; // every Alloc_free of something that wasn't NULL, and the pages.h unmappings
+
+static inline void* Alloc_malloc(size_t size) {
+	atomic_fetch_add_explicit(&alloc_count, 1, memory_order_relaxed);
+	return malloc(size);
+}
+
+static inline void* Alloc_calloc(size_t count, size_t size) {
+	atomic_fetch_add_explicit(&alloc_count, 1, memory_order_relaxed);
+	return calloc(count, size);
+}
+
+// counted as an allocation even when it manages in place, it may not
+static inline void* Alloc_realloc(void* p, size_t size) {
+	atomic_fetch_add_explicit(&alloc_count, 1, memory_order_relaxed);
+	return realloc(p, size);
+}
+
+static inline void* Alloc_aligned(size_t alignment, size_t size) {
+	atomic_fetch_add_explicit(&alloc_count, 1, memory_order_relaxed);
+	return aligned_alloc(alignment, size);
+}
+
+static inline void Alloc_free(void* p) {
+	if (p == NULL) return;
+	atomic_fetch_add_explicit(&free_count, 1, memory_order_relaxed);
+	free(p);
+}
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef ARENA
+#define ARENA
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "alloc.h"
+#include "pages.h"
+
+// bump allocator for things that all go away together, like everything a scene is made of. allocations are carved
+// out of big blocks and can't be freed one by one, only all at once with Arena_reset (which keeps a block for next
+// time) or Arena_free. a new block is as big as everything allocated since the reset, so n bytes take O(log n)
+// mallocs however they're split up. an array that's alone in its block grows with Pages_grow instead of being
+// copied, so one array per arena grows like it would with realloc. the blocks come from Pages_alloc, so they're
+// on huge pages when huge_pages is on
+
+#define ARENA_ALIGN 64 // a cache line, which is more than anything in here needs
+#define ARENA_MIN_BLOCK (64 * 1024)
+
+typedef struct ArenaBlock {
+	struct ArenaBlock* prev;
+	size_t size; // bytes after the header
+	size_t used;
+	size_t mapped; // bytes including the header, for Pages_free
+	PagesKind kind;
+} ArenaBlock;
+
+// keeps the data after the header aligned
+#define ARENA_HEADER ((sizeof(ArenaBlock) + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN)
+
+typedef struct {
+	ArenaBlock* block; // the one being allocated from, the older ones hang off its prev
+	void* last; // the most recent allocation, which Arena_grow can extend in place
+	size_t used; // bytes allocated since the last reset, over all the blocks
+	size_t next_block; // what the first block after a reset is sized to, see Arena_reset
+} Arena;
+
+Arena MakeArena() {
+	return (Arena){0};
+}
+
+static inline size_t Arena_round(size_t size) {
+	return (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+}
+
+static inline char* Arena_data(ArenaBlock* b) {
+	return (char*)b + ARENA_HEADER;
+}
+
+// starts a block with room for at least size bytes
+bool Arena_newBlock(Arena* a, size_t size) {
+	size_t block_size = a->used > size ? a->used : size;
+	if (a->block == NULL && a->next_block > block_size) block_size = a->next_block;
+	if (block_size < ARENA_MIN_BLOCK) block_size = ARENA_MIN_BLOCK;
+
+	size_t mapped = ARENA_HEADER + block_size;
+	PagesKind kind;
+	ArenaBlock* b = (ArenaBlock*)Pages_alloc(&mapped, &kind);
+	if (b == NULL) return false;
+	b->prev = a->block;
+	b->size = mapped - ARENA_HEADER; // whatever Pages_alloc rounded it up to
+	b->used = 0;
+	b->mapped = mapped;
+	b->kind = kind;
+	a->block = b;
+	return true;
+}
+
+// size bytes, aligned to ARENA_ALIGN and not zeroed. NULL if out of memory
+void* Arena_alloc(Arena* a, size_t size) {
+	size = Arena_round(size);
+	if (a->block == NULL || a->block->used + size > a->block->size) {
+		if (!Arena_newBlock(a, size)) return NULL;
+	}
+	void* p = Arena_data(a->block) + a->block->used;
+	a->block->used += size;
+	a->used += size;
+	a->last = p;
+	return p;
+}
+
+// realloc for arrays in the arena: the last allocation grows in place if its block has room, or grows the block
+// with Pages_grow if it's the only thing in it. anything else gets copied to a new spot, and the old one is wasted
+// until the arena is reset
+void* Arena_grow(Arena* a, void* p, size_t old_size, size_t new_size) {
+	if (p == NULL) return Arena_alloc(a, new_size);
+
+	old_size = Arena_round(old_size);
+	new_size = Arena_round(new_size);
+	if (new_size <= old_size) return p;
+	if (p == a->last && a->block->used - old_size + new_size <= a->block->size) {
+		a->block->used += new_size - old_size;
+		a->used += new_size - old_size;
+		return p;
+	}
+	if (p == a->last && p == Arena_data(a->block)) {
+		// at least doubling, so the next few Arena_grow calls are the in place kind above
+		size_t mapped = ARENA_HEADER + (new_size > 2 * a->block->size ? new_size : 2 * a->block->size);
+		ArenaBlock* b = (ArenaBlock*)Pages_grow(a->block, a->block->mapped, &mapped, a->block->kind);
+		if (b != NULL) {
+			b->size = mapped - ARENA_HEADER;
+			b->used = new_size;
+			b->mapped = mapped;
+			a->block = b;
+			a->last = Arena_data(b);
+			a->used += new_size - old_size;
+			return a->last;
+		}
+	}
+
+	void* q = Arena_alloc(a, new_size);
+	if (q != NULL) memcpy(q, p, old_size);
+	return q;
+}
+
+// frees everything allocated so far. the newest block is kept if it could hold all of it on its own, otherwise
+// every block goes and the next one is made that big, so allocating the same things again after a reset takes one
+// block the first time and none after that, without holding on to the old blocks and the new one at once
+void Arena_reset(Arena* a) {
+	if (a->block == NULL) return;
+	ArenaBlock* keep = a->block->size >= a->used ? a->block : NULL;
+	ArenaBlock* b = a->block;
+	while (b != NULL) {
+		ArenaBlock* prev = b->prev;
+		if (b != keep) Pages_free(b, b->mapped, b->kind);
+		b = prev;
+	}
+	if (keep != NULL) {
+		keep->prev = NULL;
+		keep->used = 0;
+	}
+	a->block = keep;
+	a->next_block = keep != NULL ? 0 : a->used;
+	a->used = 0;
+	a->last = NULL;
+}
+
+void Arena_free(Arena* a) {
+	Arena_reset(a);
+	if (a->block != NULL) Pages_free(a->block, a->block->mapped, a->block->kind);
+	*a = MakeArena();
+}
+
+// bytes the arena holds on to, for the bench
+size_t Arena_capacity(Arena* a) {
+	size_t total = 0;
+	for (ArenaBlock* b = a->block; b != NULL; b = b->prev) total += b->size;
+	return total;
+}
+
+#endif
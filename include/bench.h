@@ -0,0 +1,13 @@
+#ifndef BENCH
+#define BENCH
+#include "bench_fixture.h"
+#include "bench_world.h"
+#include "bench_sampling.h"
+#include "bench_display.h"
+#include "bench_render.h"
+#include "bench_memory.h"
+
+// microbenchmarks, run with `./build/raytracer --bench`. one header per part of the renderer they measure, with
+// what they share in bench_fixture.h
+
+#endif
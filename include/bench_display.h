@@ -0,0 +1,253 @@
+#ifndef BENCH_DISPLAY
+#define BENCH_DISPLAY
+#include "bench_fixture.h"
+#include "picture.h"
+#include "render.h"
+#include "denoise.h"
+#include "tonemap.h"
+#include "display.h"
+#include "jobs.h"
+
+// getting the picture on screen: the denoiser, the framebuffer layout, converting to 8 bit colors and upscaling
+
+// full hd denoise time, on a picture with a few passes of sexy_scene in it
+void bench_denoise() {
+	const int w = 1920, h = 1080;
+	const int passes = 4;
+
+	HittableList world = bench_sexyScene(w, h);
+
+	Sampler sampler = MakeSobolSampler(1);
+	Picture pic = MakePicture(w, h);
+	for (int i = 0; i < passes; i++) {
+		render_pass(&world, &pic, &sampler);
+	}
+
+	Denoiser denoiser = MakeDenoiser();
+	Denoiser_run(&denoiser, &pic); // first run allocates
+
+	const int reps = 5;
+	double start = bench_now();
+	for (int i = 0; i < reps; i++) {
+		Denoiser_invalidate(&denoiser);
+		Denoiser_run(&denoiser, &pic);
+	}
+	printf("denoiser (%dx%d, %d iterations, %d threads): %.1f ms\r\n", w, h, denoiser.iterations, jobs.thread_count + 1, (bench_now() - start) * 1000 / reps);
+
+	Denoiser_free(&denoiser);
+	Picture_free(&pic);
+	Sampler_free(&sampler);
+	HittableList_free(&world);
+}
+
+// accumulating one sample into every pixel of a 4K picture and converting it all to 8 bit colors, like a frame does
+// minus the tracing. the old layout (one allocation per column, walked row by row) is rebuilt here to compare
+void bench_framebuffer() {
+	const int w = 3840, h = 2160;
+	const int frames = 10;
+	Color* out = (Color*)Alloc_malloc(w * h * sizeof(Color));
+	Vec3 sample = color(0.25, 0.5, 0.75);
+
+	// before: Vec3* per column, pixels visited row by row
+	Vec3** columns = (Vec3**)Alloc_malloc(w * sizeof(Vec3*));
+	int* counts = (int*)Alloc_calloc(w * h, sizeof(int));
+	for (int i = 0; i < w; i++) {
+		columns[i] = (Vec3*)Alloc_calloc(h, sizeof(Vec3));
+	}
+	double start = bench_now();
+	for (int frame = 0; frame < frames; frame++) {
+		for (int j = 0; j < h; j++) {
+			for (int i = 0; i < w; i++) {
+				columns[i][j] = Vec3Add(columns[i][j], sample);
+				counts[j * w + i]++;
+			}
+		}
+		for (int j = h - 1; j >= 0; j--) {
+			for (int i = 0; i < w; i++) {
+				out[(h - 1 - j) * w + i] = Vec3ToColor(Vec3Scale(columns[i][j], 1.0f / counts[j * w + i]), 1.0);
+			}
+		}
+	}
+	double columns_ms = (bench_now() - start) * 1000 / frames;
+	for (int i = 0; i < w; i++) {
+		Alloc_free(columns[i]);
+	}
+	Alloc_free(columns);
+	Alloc_free(counts);
+
+	// after: one tile-ordered block, walked tile by tile
+	Picture pic = MakePicture(w, h);
+	start = bench_now();
+	for (int frame = 0; frame < frames; frame++) {
+		for (int tile = 0; tile < Picture_tileCount(&pic); tile++) {
+			int x0, y0, x1, y1;
+			Picture_tileBounds(&pic, tile, &x0, &y0, &x1, &y1);
+			for (int j = y0; j < y1; j++) {
+				for (int i = x0; i < x1; i++) {
+					Picture_addSample(&pic, i, j, sample);
+				}
+			}
+		}
+		for (int tile = 0; tile < Picture_tileCount(&pic); tile++) {
+			int x0, y0, x1, y1;
+			Picture_tileBounds(&pic, tile, &x0, &y0, &x1, &y1);
+			Vec3* sums = Picture_tile(&pic, tile);
+			for (int j = y0; j < y1; j++) {
+				for (int i = x0; i < x1; i++) {
+					out[(h - 1 - j) * w + i] = Vec3ToColor(Picture_resolve(sums[(j - y0) * TILE_SIZE + i - x0]), 1.0);
+				}
+			}
+		}
+	}
+	double tiles_ms = (bench_now() - start) * 1000 / frames;
+	Picture_free(&pic);
+
+	printf("accumulate + display one frame at %dx%d:\r\n", w, h);
+	printf("\tcolumn per allocation   %7.1f ms\r\n", columns_ms);
+	printf("\ttile order, contiguous  %7.1f ms\r\n", tiles_ms);
+	printf("\t(checksum %d)\r\n", out[w * h / 2].r);
+	Alloc_free(out);
+}
+
+typedef struct {
+	Picture* pic;
+	Color* out;
+	Tonemap tonemap;
+} BenchResolve;
+
+void bench_resolveTile(void* arg, int tile) {
+	BenchResolve* b = (BenchResolve*)arg;
+	int x0, y0, x1, y1;
+	Picture_tileBounds(b->pic, tile, &x0, &y0, &x1, &y1);
+	for (int v = y0; v < y1; v++) {
+		Tonemap_row(b->tonemap, Picture_tile(b->pic, tile) + (v - y0) * TILE_SIZE, b->out + (b->pic->height - 1 - v) * b->pic->width + x0, x1 - x0, true);
+	}
+}
+
+// turning a 4K picture into 8 bit colors: Vec3ToColor per pixel vs the tonemap.h rows, on one thread and on all
+void bench_resolve() {
+	const int w = 3840, h = 2160;
+	const int reps = 10;
+	Color* out = (Color*)Alloc_malloc(w * h * sizeof(Color));
+	Picture pic = MakePicture(w, h);
+	for (int v = 0; v < h; v++) {
+		for (int u = 0; u < w; u++) {
+			Picture_addSample(&pic, u, v, Vec3RandRange(0, 2));
+		}
+	}
+
+	printf("resolve %dx%d to 8 bit:\r\n", w, h);
+	double start = bench_now();
+	for (int rep = 0; rep < reps; rep++) {
+		for (int v = 0; v < h; v++) {
+			for (int u = 0; u < w; u++) {
+				out[(h - 1 - v) * w + u] = Vec3ToColor(Picture_mean(&pic, u, v), 1.0);
+			}
+		}
+	}
+	printf("\t%-34s %7.2f ms\r\n", "Vec3ToColor", (bench_now() - start) * 1000 / reps);
+
+	BenchResolve b = {&pic, out, MakeTonemap()};
+	for (int op = 0; op < TONEMAP_COUNT; op++) {
+		b.tonemap.op = op;
+		start = bench_now();
+		for (int rep = 0; rep < reps; rep++) {
+			for (int tile = 0; tile < Picture_tileCount(&pic); tile++) {
+				bench_resolveTile(&b, tile);
+			}
+		}
+		char label[64];
+		sprintf(label, "Tonemap_row (%s)", tonemap_names[op]);
+		printf("\t%-34s %7.2f ms\r\n", label, (bench_now() - start) * 1000 / reps);
+	}
+
+	b.tonemap.op = TONEMAP_ACES;
+	start = bench_now();
+	for (int rep = 0; rep < reps; rep++) {
+		Jobs_parallelFor(Picture_tileCount(&pic), bench_resolveTile, &b);
+	}
+	char label[64];
+	sprintf(label, "Tonemap_row (aces, %d threads)", jobs.thread_count + 1);
+	printf("\t%-34s %7.2f ms\r\n", label, (bench_now() - start) * 1000 / reps);
+	printf("\t(checksum %d)\r\n", out[w * h / 2].r);
+
+	Picture_free(&pic);
+	Alloc_free(out);
+}
+
+// sets up d to show pic at out_width x out_height without touching the gpu, and upscales it
+void bench_upscaleInto(Display* d, Picture* pic, int out_width, int out_height) {
+	*d = MakeDisplay();
+	Display_allocate(d, pic->width, pic->height, out_width, out_height);
+	d->shown_tonemap = MakeTonemap();
+	d->pic = pic;
+	d->tile_count = Picture_tileCount(pic);
+	for (int tile = 0; tile < d->tile_count; tile++) d->tiles[tile] = tile;
+
+	Jobs_parallelFor(d->tile_count, Display_convertTile, d);
+	Jobs_parallelFor(out_height, Display_upscaleRow, d);
+}
+
+// a half resolution picture scaled up to the window, compared to a full resolution reference on screen (after
+// gamma), and how long upscaling to 1080p takes
+void bench_upscale() {
+	const int w = 160, h = 120;
+	const int spp = 128;
+
+	HittableList world = bench_sexyScene(w, h);
+	float* reference = bench_reference(&world, w, h, spp, true);
+
+	Sampler sampler = MakeSobolSampler(1);
+	Picture pic = MakePicture(w / 2, h / 2);
+	for (int i = 0; i < spp; i++) {
+		render_pass(&world, &pic, &sampler);
+	}
+
+	printf("upscaling %dx%d to %dx%d (sexy_scene, RMSE after gamma):\r\n", w / 2, h / 2, w, h);
+	Display d;
+	bench_upscaleInto(&d, &pic, w, h);
+	double sum = 0;
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			Color c = d.upscaled[y * w + x];
+			unsigned char shown[3] = {c.r, c.g, c.b};
+			for (int k = 0; k < 3; k++) {
+				double e = shown[k] / 255.0 - sqrt(reference[((h - 1 - y) * w + x) * 3 + k]);
+				sum += e * e;
+			}
+		}
+	}
+	printf("\tbilinear             %.4f\r\n", sqrt(sum / (w * h * 3)));
+	Display_free(&d);
+	Picture_free(&pic);
+
+	const int out_w = 1920, out_h = 1080;
+	HittableList_free(&world);
+	world = bench_sexyScene(out_w / 2, out_h / 2);
+	pic = MakePicture(out_w / 2, out_h / 2);
+	bench_upscaleInto(&d, &pic, out_w, out_h);
+	const int reps = 10;
+	double start = bench_now();
+	for (int i = 0; i < reps; i++) {
+		Jobs_parallelFor(out_h, Display_upscaleRow, &d);
+	}
+	printf("\t%dx%d to %dx%d         %.2f ms\r\n", out_w / 2, out_h / 2, out_w, out_h, (bench_now() - start) * 1000 / reps);
+	Display_free(&d);
+	Picture_free(&pic);
+	Alloc_free(reference);
+	HittableList_free(&world);
+}
+
+// the cpu half of Display_update for every tile, so it runs without a window
+void bench_display(Display* d, Picture* pic, Denoiser* denoiser, int out_width, int out_height) {
+	Display_reserve(d, pic->width, pic->height, out_width, out_height);
+	d->shown_tonemap = MakeTonemap();
+	d->pic = pic;
+	d->denoiser = denoiser;
+	d->tile_count = Picture_tileCount(pic);
+	for (int tile = 0; tile < d->tile_count; tile++) d->tiles[tile] = tile;
+	Jobs_parallelFor(d->tile_count, Display_convertTile, d);
+	Jobs_parallelFor(out_height, Display_upscaleRow, d);
+}
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef BENCH_FIXTURE
+#define BENCH_FIXTURE
+#include "raylib.h"
+#include "raymath.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+#include "utils.h"
+#include "alloc.h"
+#include "hittable_list.h"
+#include "scenes.h"
+#include "sampler.h"
+#include "integrator.h"
+#include "picture.h"
+#include "denoise.h"
+
+// what the benches share: timing, the reference render everything's error is measured against, and turning
+// pictures into bench_render's layout to compare them with it
+
+#define BENCH_N 4096
+#define BENCH_REPS 2000
+
+double bench_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// runs `body` for i in [0, BENCH_N) `reps` times and prints the time per iteration
+#define BENCH_LOOP(label, reps, body) { \
+	double bench_start = bench_now(); \
+	for (int rep = 0; rep < reps; rep++) { \
+		for (int i = 0; i < BENCH_N; i++) { \
+			body; \
+		} \
+	} \
+	printf("\t%-24s %7.2f ns/op\r\n", label, (bench_now() - bench_start) * 1e9 / ((double)(reps) * BENCH_N)); \
+}
+
+// renders spp samples per pixel into out (w * h * 3 floats)
+void bench_render(HittableList* world, Sampler* sampler, int w, int h, int spp, float* out) {
+	for (int j = 0; j < h; j++) {
+		for (int i = 0; i < w; i++) {
+			Vec3 sum = color(0, 0, 0);
+			for (int s = 0; s < spp; s++) {
+				PixelSample ps = {sampler, i, j, s, DIM_PIXEL};
+				double u = (i + PixelSample_next(&ps)) / (w - 1);
+				double v = (j + PixelSample_next(&ps)) / (h - 1);
+				ps.dim = DIM_LENS;
+				double lens_u = PixelSample_next(&ps);
+				double lens_v = PixelSample_next(&ps);
+				sum = Vec3Add(sum, ray_color(Camera_getRay(world->camera, u, v, lens_u, lens_v), world, max_bounces, &ps, NULL));
+			}
+			for (int c = 0; c < 3; c++) {
+				out[(j * w + i) * 3 + c] = sum.e[c] / spp;
+			}
+		}
+	}
+}
+
+double bench_rmse(float* a, float* b, int n) {
+	double sum = 0;
+	for (int i = 0; i < n; i++) {
+		sum += (a[i] - b[i]) * (a[i] - b[i]);
+	}
+	return sqrt(sum / n);
+}
+
+// sexy_scene with the camera set up for a w x h picture, which is what most of these look at
+HittableList bench_sexyScene(int w, int h) {
+	HittableList world = sexy_scene();
+	Camera_update(&(world.camera), world.camera.origin, world.camera.lookat, world.camera.vup, world.camera.vfov, world.camera.aperture, world.camera.focus_dist, w, h);
+	return world;
+}
+
+// what the error gets measured against: spp random samples per pixel of world with the same seed every time, in
+// bench_render's layout. with clamp set it's clamped to 1 like the screen would. free with Alloc_free
+float* bench_reference(HittableList* world, int w, int h, int spp, bool clamp) {
+	float* reference = (float*)Alloc_malloc(w * h * 3 * sizeof(float));
+	Sampler sampler = MakeRandomSampler(0xdecaf);
+	bench_render(world, &sampler, w, h, spp, reference);
+	Sampler_free(&sampler);
+	if (clamp) {
+		for (int i = 0; i < w * h * 3; i++) reference[i] = fminf(reference[i], 1.0f);
+	}
+	return reference;
+}
+
+// copies the denoiser's output into the same layout bench_render uses, clamped like the screen would
+void bench_denoised(Denoiser* d, float* out) {
+	for (int j = 0; j < d->height; j++) {
+		for (int i = 0; i < d->width; i++) {
+			Vec3 c = Denoiser_at(d, i, d->height - 1 - j);
+			for (int k = 0; k < 3; k++) {
+				out[(j * d->width + i) * 3 + k] = fminf(c.e[k], 1.0f);
+			}
+		}
+	}
+}
+
+// mean of the picture in the same layout bench_render uses, clamped like the screen would
+void bench_picture(Picture* pic, float* out) {
+	for (int j = 0; j < pic->height; j++) {
+		for (int i = 0; i < pic->width; i++) {
+			Vec3 c = Picture_mean(pic, i, j);
+			for (int k = 0; k < 3; k++) {
+				out[(j * pic->width + i) * 3 + k] = fminf(c.e[k], 1.0f);
+			}
+		}
+	}
+}
+
+// like bench_picture, but with untraced pixels of a preview filled in the way the display does it
+void bench_shown(Picture* pic, float* out) {
+	for (int j = 0; j < pic->height; j++) {
+		for (int i = 0; i < pic->width; i++) {
+			int u = i, v = j;
+			Picture_previewSource(pic, &u, &v);
+			Vec3 c = Picture_mean(pic, u, v);
+			for (int k = 0; k < 3; k++) {
+				out[(j * pic->width + i) * 3 + k] = fminf(c.e[k], 1.0f);
+			}
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,196 @@
+#ifndef BENCH_MEMORY
+#define BENCH_MEMORY
+#include <stdatomic.h>
+#include "bench_fixture.h"
+#include "bench_display.h"
+#include "alloc.h"
+#include "arena.h"
+#include "pages.h"
+#include "hittable_list.h"
+#include "picture.h"
+#include "render.h"
+#include "denoise.h"
+#include "display.h"
+
+// memory: building scenes in arenas, huge pages, and the render loop's heap allocations
+
+// a scene of n small spheres with a material each, in list, like a scene function would make but without the
+// printing. every load replaces the last one
+void bench_loadScene(HittableList* list, int n) {
+	HittableList_clear(list);
+	srand(7);
+	for (int i = 0; i < n; i++) {
+		int m = HittableList_addMat(list, MakeLambertian(Vec3RandRange(0, 1)));
+		HittableList_add(list, MakeSphere(Vec3RandRange(-100, 100), 0.5, m));
+	}
+	list->first_child = MakeBVHNode(&(list->arena), list->objects, 0, list->len);
+	HittableList_buildLights(list);
+}
+
+// appending objects to a big scene with a realloc per object like HittableList_add used to do vs the arena,
+// and loading a scene over and over into the same list, which should stop allocating after the first time
+void bench_scene() {
+	const int n = 200000;
+	const int loads = 3;
+	Hittable sphere = MakeSphere(point3(0, 0, 0), 0.5, 0);
+
+	printf("building scenes (%d spheres):\r\n", n);
+	double start = bench_now();
+	Hittable* objects = NULL;
+	for (int i = 0; i < n; i++) {
+		objects = (Hittable*)Alloc_realloc(objects, sizeof(Hittable) * (i + 1));
+		objects[i] = sphere;
+	}
+	double grown = bench_now() - start;
+	Alloc_free(objects);
+
+	HittableList list = MakeHittableList();
+	long allocations = atomic_load(&alloc_count);
+	start = bench_now();
+	for (int i = 0; i < n; i++) HittableList_add(&list, sphere);
+	printf("\t%-28s %7.2f ms, %d allocations\r\n", "realloc per object", grown * 1000, n);
+	printf("\t%-28s %7.2f ms, %ld allocations\r\n", "arena", (bench_now() - start) * 1000, atomic_load(&alloc_count) - allocations);
+
+	for (int i = 0; i < loads; i++) {
+		allocations = atomic_load(&alloc_count);
+		start = bench_now();
+		bench_loadScene(&list, n);
+		printf("\tload %d, with the BVH          %7.2f ms, %ld allocations, %.1f MB held\r\n", i + 1, (bench_now() - start) * 1000, atomic_load(&alloc_count) - allocations, HittableList_capacity(&list) / 1e6);
+	}
+	HittableList_free(&list);
+}
+
+// how much of the process' memory the kernel has put on transparent huge pages, in MB. 0 if it can't tell
+double bench_anonHugePages() {
+	FILE* f = fopen("/proc/self/smaps_rollup", "r");
+	if (f == NULL) return 0;
+	char line[256];
+	long kb = 0;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1) break;
+	}
+	fclose(f);
+	return kb / 1024.0;
+}
+
+// closest hit queries through a scene far bigger than the TLB covers with 4KB pages (a million small spheres,
+// rays from anywhere going anywhere, so the BVH gets walked all over), with the scene on ordinary pages vs huge
+// pages, and what the system actually gave it
+void bench_hugePages() {
+	const int n = 1000000;
+	bool old_huge_pages = huge_pages;
+
+	srand(11);
+	for (int i = 0; i < BENCH_N; i++) {
+		bench_rays[i] = ray(Vec3RandRange(-100, 100), Vec3RandRange(-1, 1));
+	}
+
+	printf("BVH traversal (%d spheres, %.0f MB of BVH and objects):\r\n", n, 2.0 * n * sizeof(Hittable) / 1e6);
+	for (int huge = 0; huge <= 1; huge++) {
+		huge_pages = huge;
+		HittableList list = MakeHittableList();
+		bench_loadScene(&list, n);
+
+		printf("\t%s, %.0f MB on huge pages:\r\n", huge ? "huge pages" : "ordinary pages", bench_anonHugePages() + atomic_load(&pages_bytes[PAGES_HUGETLB]) / 1048576.0);
+		for (int kind = 0; kind < PAGES_KINDS; kind++) {
+			long bytes = atomic_load(&pages_bytes[kind]);
+			if (bytes > 0) printf("\t\t(%.0f MB from %s)\r\n", bytes / 1048576.0, pages_names[kind]);
+		}
+		HitRecord rec;
+		BENCH_LOOP("HittableList_hit", 20, bench_outb[i] = HittableList_hit(&list, bench_rays[i], 0.001, INFINITY, &rec));
+		HittableList_free(&list);
+	}
+
+	// the BVH walk does too much else per node for the TLB to show much. this is the most huge pages can do: a
+	// random walk over a block as big as that scene, one cache line per step, so nearly every step misses the TLB
+	// on ordinary pages
+	const size_t walk_bytes = (size_t)512 << 20;
+	const int steps = 1 << 22;
+	printf("random walk over %.0f MB, one cache line per step:\r\n", walk_bytes / 1048576.0);
+	for (int huge = 0; huge <= 1; huge++) {
+		huge_pages = huge;
+		size_t size = walk_bytes;
+		PagesKind kind;
+		uint32_t* lines = (uint32_t*)Pages_alloc(&size, &kind);
+		const size_t stride = 64 / sizeof(uint32_t);
+		uint32_t count = size / 64;
+
+		// sattolo's shuffle, so the walk is one cycle through every line
+		for (uint32_t i = 0; i < count; i++) lines[i * stride] = i;
+		uint32_t x = 11;
+		for (uint32_t i = count - 1; i > 0; i--) {
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			uint32_t j = x % i;
+			uint32_t t = lines[i * stride];
+			lines[i * stride] = lines[j * stride];
+			lines[j * stride] = t;
+		}
+
+		double start = bench_now();
+		uint32_t at = 0;
+		for (int i = 0; i < steps; i++) at = lines[at * stride];
+		bench_outb[0] = at == 0;
+		printf("\t%-24s %7.2f ns/step (%s)\r\n", huge ? "huge pages" : "ordinary pages", (bench_now() - start) * 1e9 / steps, pages_names[kind]);
+		Pages_free(lines, size, kind);
+	}
+	huge_pages = old_huge_pages;
+}
+
+// heap allocations and frees made by what the main loop does every frame while the camera strafes and the
+// resolution goes up and down: starting a new picture, rendering a slice of it, denoising and scaling it up for the
+// window. once everything has been full size once there shouldn't be any. returns how many there were, so --bench
+// can fail
+long bench_allocations() {
+	const int w = 160, h = 120;
+	const int frames = 30;
+	const float scales[] = {1.0f, 0.5f, 0.75f};
+
+	HittableList world = sexy_scene();
+	Sampler sampler = MakeSobolSampler(1);
+	Picture pic = MakePicture(0, 0);
+	Picture spare = MakePicture(0, 0);
+	Denoiser denoiser = MakeDenoiser();
+	Display display = MakeDisplay();
+
+	long warm_up = 0, warm_up_frees = 0;
+	long start = atomic_load(&alloc_count), start_frees = atomic_load(&free_count);
+	for (int frame = 0; frame < 2 * frames; frame++) {
+		// the first frames are the warm up, where the buffers get allocated
+		if (frame == frames) {
+			warm_up = atomic_load(&alloc_count) - start;
+			warm_up_frees = atomic_load(&free_count) - start_frees;
+			start = atomic_load(&alloc_count);
+			start_frees = atomic_load(&free_count);
+		}
+		float scale = scales[frame % 3];
+		int pw = (int)(w * scale), ph = (int)(h * scale);
+		Cam c = world.camera;
+		Camera_update(&(world.camera), Vec3Add(c.origin, Vec3Scale(c.u, 0.05)), Vec3Add(c.lookat, Vec3Scale(c.u, 0.05)), c.vup, c.vfov, c.aperture, c.focus_dist, pw, ph);
+		render_restart(&world, &pic, &spare, pw, ph);
+		Denoiser_invalidate(&denoiser);
+		// the denoiser waits for a whole pass (see Denoiser_wanted)
+		while (pic.sample_count == 0) {
+			render_budget(&world, &pic, &sampler, 0.002);
+		}
+		Denoiser_run(&denoiser, &pic);
+		bench_display(&display, &pic, &denoiser, 2 * w, 2 * h);
+	}
+	long steady = atomic_load(&alloc_count) - start;
+	long steady_frees = atomic_load(&free_count) - start_frees;
+
+	printf("heap allocations while moving (sexy_scene, %dx%d at 1, 1/2 and 3/4 scale):\r\n", w, h);
+	printf("\t%d warm up frames %6ld allocations, %6ld frees\r\n", frames, warm_up, warm_up_frees);
+	printf("\t%d frames after   %6ld allocations, %6ld frees\r\n", frames, steady, steady_frees);
+
+	Display_freeBuffers(&display);
+	Denoiser_free(&denoiser);
+	Picture_free(&pic);
+	Picture_free(&spare);
+	Sampler_free(&sampler);
+	HittableList_free(&world);
+	return steady + steady_frees;
+}
+
+#endif
@@ -0,0 +1,227 @@
+#ifndef BENCH_RENDER
+#define BENCH_RENDER
+#include <unistd.h>
+#include "bench_fixture.h"
+#include "picture.h"
+#include "render.h"
+#include "renderer.h"
+#include "denoise.h"
+
+// the render loop: frame budgets, previews, camera moves and the render thread
+
+// a second of 60 fps frames on a small window, with one pass per frame like the main loop used to do vs filling
+// 90% of every frame with render_budget, and how far past its budget a frame went
+void bench_budget() {
+	const int w = 32, h = 24;
+	const int fps = 60;
+	const double frame = 1.0 / fps;
+
+	HittableList world = bench_sexyScene(w, h);
+	Sampler sampler = MakeSobolSampler(1);
+
+	printf("samples per second at %d fps (sexy_scene, %dx%d):\r\n", fps, w, h);
+	for (int budgeted = 0; budgeted <= 1; budgeted++) {
+		int old_spp = samples_per_pixel;
+		samples_per_pixel = 1 << 20; // so it doesn't stop early
+		Picture pic = MakePicture(w, h);
+		double worst = 0;
+		double start = bench_now();
+		for (int f = 0; f < fps; f++) {
+			double frame_start = bench_now();
+			if (budgeted) {
+				render_budget(&world, &pic, &sampler, 0.9 * frame);
+			}
+			else {
+				render_pass(&world, &pic, &sampler);
+			}
+			double took = bench_now() - frame_start;
+			if (took > worst) worst = took;
+			// waiting for vsync
+			while (bench_now() - frame_start < frame);
+		}
+		double elapsed = bench_now() - start;
+		printf("\t%-20s %9.0f samples/s, %5.1f passes, slowest frame %5.1f ms\r\n", budgeted ? "render_budget" : "one pass per frame", pic.samples_traced / elapsed, pic.sample_count + (double)pic.next_tile / Picture_tileCount(&pic), worst * 1000);
+		Picture_free(&pic);
+		samples_per_pixel = old_spp;
+	}
+	HittableList_free(&world);
+}
+
+// time until something is on screen after a change, when the first pass is traced all at once vs coarse to fine,
+// and what tracing the whole first pass costs either way
+void bench_preview() {
+	const int w = 640, h = 480;
+	HittableList world = bench_sexyScene(w, h);
+	Sampler sampler = MakeSobolSampler(1);
+
+	printf("first pass after a change (sexy_scene, %dx%d):\r\n", w, h);
+	for (int stride = 1; stride <= preview_stride; stride *= preview_stride) {
+		Picture pic = MakePicture(w, h);
+		pic.preview_step = stride > 1 ? stride : 0;
+
+		double start = bench_now();
+		render_pass(&world, &pic, &sampler);
+		double first_frame = bench_now() - start;
+		while (pic.sample_count == 0) {
+			render_pass(&world, &pic, &sampler);
+		}
+		double whole_pass = bench_now() - start;
+
+		printf("\t%-20s first frame %7.1f ms, whole pass %7.1f ms, %lld samples\r\n", stride > 1 ? "coarse to fine" : "all at once", first_frame * 1000, whole_pass * 1000, pic.samples_traced);
+		Picture_free(&pic);
+	}
+	HittableList_free(&world);
+}
+
+// strafes the camera with only the first preview step traced every frame, which is all a frame gets while the
+// camera keeps moving on a big picture. the preview grid either stays put or moves to the next pixel of its
+// cell every frame, and the rest comes from the reprojected history
+void bench_interleave() {
+	const int w = 160, h = 120;
+	const int frames = 16;
+
+	float* reference = NULL;
+	float* image = (float*)Alloc_malloc(w * h * 3 * sizeof(float));
+	Sampler sampler = MakeSobolSampler(1);
+
+	printf("camera moves with a 1/%d preview per frame (sexy_scene, %dx%d, RMSE after %d frames):\r\n", preview_stride * preview_stride, w, h, frames);
+	for (int interleaved = 0; interleaved <= 1; interleaved++) {
+		HittableList world = bench_sexyScene(w, h);
+		Picture pic = MakePicture(w, h);
+		for (int frame = 0; frame < frames; frame++) {
+			Cam c = world.camera;
+			Camera_update(&(world.camera), Vec3Add(c.origin, Vec3Scale(c.u, 0.02)), Vec3Add(c.lookat, Vec3Scale(c.u, 0.02)), c.vup, c.vfov, c.aperture, c.focus_dist, w, h);
+
+			Picture old = pic;
+			pic = MakePicture(w, h);
+			pic.first_index = old.first_index + old.sample_count;
+			pic.preview_step = preview_stride;
+			pic.preview_phase = interleaved ? old.preview_phase + 1 : 0;
+			render_reproject(&world, &pic, &old);
+			Picture_free(&old);
+			render_pass(&world, &pic, &sampler);
+		}
+
+		if (!interleaved) {
+			reference = bench_reference(&world, w, h, 256, true);
+		}
+
+		float history = 0;
+		for (int j = 0; j < h; j++) {
+			for (int i = 0; i < w; i++) history += Picture_weight(&pic, i, j);
+		}
+		bench_shown(&pic, image);
+		printf("\t%-20s %.4f, %.1f samples per pixel on average\r\n", interleaved ? "moving grid" : "fixed grid", bench_rmse(image, reference, w * h * 3), history / (w * h));
+		Picture_free(&pic);
+		HittableList_free(&world);
+	}
+
+	Alloc_free(reference);
+	Alloc_free(image);
+	Sampler_free(&sampler);
+}
+
+// how long the ui thread waits to get the picture from the render thread at a random moment, for an ordinary
+// frame (the batch in progress stops at the next tile) vs a camera move (it gets cancelled within a path)
+void bench_cancel() {
+	const int w = 320, h = 240;
+	const int trials = 20;
+	HittableList world = bench_sexyScene(w, h);
+	Sampler sampler = MakeSobolSampler(1);
+	Picture pic = MakePicture(w, h);
+	Picture spare = MakePicture(0, 0);
+	pic.preview_step = 0;
+
+	printf("waiting for the render thread (sexy_scene, %dx%d):\r\n", w, h);
+	double slices[] = {1.0 / 120, 0.1};
+	for (int s = 0; s < 2; s++) {
+		Renderer r = MakeRenderer(&world, &pic, &spare, &sampler, slices[s]);
+		Renderer_start(&r);
+		for (int cancel = 0; cancel <= 1; cancel++) {
+			double total = 0, worst = 0;
+			srand(1);
+			for (int i = 0; i < trials; i++) {
+				usleep(5000 + rand() % 20000);
+				double start = bench_now();
+				Renderer_lock(&r, cancel);
+				double waited = bench_now() - start;
+				Renderer_unlock(&r);
+				total += waited;
+				if (waited > worst) worst = waited;
+			}
+			printf("\t%3.0f ms slices, %-10s %7.3f ms on average, %7.3f ms at worst\r\n", slices[s] * 1000, cancel ? "cancelled" : "preempted", total * 1000 / trials, worst * 1000);
+		}
+		Renderer_stop(&r);
+	}
+
+	Picture_free(&pic);
+	Picture_free(&spare);
+	Sampler_free(&sampler);
+	HittableList_free(&world);
+}
+
+// strafes the camera for a few frames with one pass per frame, like holding down a key does, and compares the
+// last frame to a reference, with every move starting a fresh picture vs reprojecting the old one into it
+void bench_reprojection() {
+	const int w = 160, h = 120;
+	const int frames = 12;
+
+	HittableList world = bench_sexyScene(w, h);
+	Sampler sampler = MakeSobolSampler(1);
+	Picture fresh = MakePicture(w, h);
+	Picture reprojected = MakePicture(w, h);
+	Denoiser denoiser = MakeDenoiser();
+	double reprojection_time = 0;
+
+	for (int frame = 0; frame < frames; frame++) {
+		Cam c = world.camera;
+		Camera_update(&(world.camera), Vec3Add(c.origin, Vec3Scale(c.u, 0.05)), Vec3Add(c.lookat, Vec3Scale(c.u, 0.05)), c.vup, c.vfov, c.aperture, c.focus_dist, w, h);
+
+		uint32_t next_index = fresh.first_index + fresh.sample_count;
+		Picture_free(&fresh);
+		fresh = MakePicture(w, h);
+		fresh.first_index = next_index;
+		render_pass(&world, &fresh, &sampler);
+
+		Picture old = reprojected;
+		reprojected = MakePicture(w, h);
+		reprojected.first_index = old.first_index + old.sample_count;
+		double start = bench_now();
+		render_reproject(&world, &reprojected, &old);
+		reprojection_time += bench_now() - start;
+		Picture_free(&old);
+		render_pass(&world, &reprojected, &sampler);
+	}
+
+	float* reference = bench_reference(&world, w, h, 512, true);
+	float* image = (float*)Alloc_malloc(w * h * 3 * sizeof(float));
+
+	int kept = 0;
+	for (int j = 0; j < h; j++) {
+		for (int i = 0; i < w; i++) kept += Picture_history(&reprojected, i, j) > 0;
+	}
+
+	printf("camera moves (sexy_scene, %dx%d, 1 pass per frame, RMSE after %d frames):\r\n", w, h, frames);
+	bench_picture(&fresh, image);
+	printf("\tfresh picture             %.4f\r\n", bench_rmse(image, reference, w * h * 3));
+	Denoiser_run(&denoiser, &fresh);
+	bench_denoised(&denoiser, image);
+	printf("\tfresh picture, denoised   %.4f\r\n", bench_rmse(image, reference, w * h * 3));
+	bench_picture(&reprojected, image);
+	printf("\treprojected               %.4f\r\n", bench_rmse(image, reference, w * h * 3));
+	Denoiser_invalidate(&denoiser);
+	Denoiser_run(&denoiser, &reprojected);
+	bench_denoised(&denoiser, image);
+	printf("\treprojected, denoised     %.4f\r\n", bench_rmse(image, reference, w * h * 3));
+	printf("\t(%.1f%% of pixels kept their history, reprojection took %.2f ms per frame)\r\n", 100.0 * kept / (w * h), reprojection_time * 1000 / frames);
+
+	Alloc_free(reference);
+	Alloc_free(image);
+	Denoiser_free(&denoiser);
+	Picture_free(&fresh);
+	Picture_free(&reprojected);
+	Sampler_free(&sampler);
+	HittableList_free(&world);
+}
+
+#endif
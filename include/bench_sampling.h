@@ -0,0 +1,115 @@
+#ifndef BENCH_SAMPLING
+#define BENCH_SAMPLING
+#include "bench_fixture.h"
+#include "scenes.h"
+#include "sampler.h"
+#include "picture.h"
+#include "render.h"
+
+// where the samples go: samplers, adaptive sampling and foveation, by error against the reference
+
+// error against a high sample count reference for every sampler, at a few sample counts
+void bench_samplers() {
+	const int w = 64, h = 48;
+	const int spp_list[] = {4, 16, 64};
+
+	HittableList world = bench_sexyScene(w, h);
+
+	float* reference = bench_reference(&world, w, h, 2048, false);
+	float* image = (float*)Alloc_malloc(w * h * 3 * sizeof(float));
+
+	Sampler samplers[] = {
+		MakeRandomSampler(1),
+		MakeStratifiedSampler(1, 64),
+		MakeSobolSampler(1),
+		MakeBlueNoiseSampler(1)
+	};
+
+	printf("sampler RMSE vs 2048 spp reference (sexy_scene, %dx%d):\r\n", w, h);
+	for (int i = 0; i < (int)(sizeof(samplers) / sizeof(Sampler)); i++) {
+		printf("\t%-12s", samplers[i].name);
+		for (int k = 0; k < (int)(sizeof(spp_list) / sizeof(int)); k++) {
+			bench_render(&world, &samplers[i], w, h, spp_list[k], image);
+			printf("  %3d spp: %.4f", spp_list[k], bench_rmse(image, reference, w * h * 3));
+		}
+		printf("\r\n");
+		Sampler_free(&samplers[i]);
+	}
+
+	Alloc_free(reference);
+	Alloc_free(image);
+	HittableList_free(&world);
+}
+
+void bench_adaptive_scene(const char* name, HittableList world) {
+	const int w = 192, h = 144;
+	Camera_update(&(world.camera), world.camera.origin, world.camera.lookat, world.camera.vup, world.camera.vfov, world.camera.aperture, world.camera.focus_dist, w, h);
+
+	Sampler sampler = MakeSobolSampler(1);
+	Picture pic = MakePicture(w, h);
+	double start = bench_now();
+	while (!render_done(&pic)) {
+		render_pass(&world, &pic, &sampler);
+	}
+	printf("\t%-20s %4d passes, %.1f%% of samples saved, %.2fs\r\n", name, pic.sample_count, 100 * render_savings(&pic), bench_now() - start);
+	Picture_free(&pic);
+	Sampler_free(&sampler);
+	HittableList_free(&world);
+}
+
+// how much adaptive sampling saves on each scene, with the sample cap lowered so this doesn't take all day
+void bench_adaptive() {
+	int old_spp = samples_per_pixel;
+	samples_per_pixel = 128;
+
+	printf("adaptive sampling (cap %d spp, target error %g):\r\n", samples_per_pixel, adaptive_threshold);
+	bench_adaptive_scene("sexy_scene", sexy_scene());
+	bench_adaptive_scene("random_scene", random_scene());
+	bench_adaptive_scene("bright_light_scene", bright_light_scene());
+
+	samples_per_pixel = old_spp;
+}
+
+// error inside a region of interest after the same number of samples, with them spread over the whole picture
+// vs foveated around the region
+void bench_focus() {
+	const int w = 160, h = 120;
+	const int x0 = 60, y0 = 40, x1 = 100, y1 = 80; // around the glass ball in the middle
+	const long long budget = 4LL * w * h;
+
+	HittableList world = bench_sexyScene(w, h);
+	float* reference = bench_reference(&world, w, h, 256, true);
+	float* image = (float*)Alloc_malloc(w * h * 3 * sizeof(float));
+	Sampler sampler = MakeSobolSampler(1);
+
+	printf("region of interest (sexy_scene, %dx%d, %dx%d region, RMSE in it after %lld samples):\r\n", w, h, x1 - x0, y1 - y0, budget);
+	Focus old_focus = render_focus;
+	for (int focused = 0; focused <= 1; focused++) {
+		render_focus = (Focus){focused, x0, y0, x1 - 1, y1 - 1, 0, 0.1f * h, 1.0f / 16};
+		Picture pic = MakePicture(w, h);
+		pic.preview_step = 0;
+		while (pic.samples_traced < budget && !render_done(&pic)) {
+			render_pass(&world, &pic, &sampler);
+		}
+		bench_picture(&pic, image);
+
+		double sum = 0;
+		for (int j = y0; j < y1; j++) {
+			for (int i = x0 * 3; i < x1 * 3; i++) {
+				float d = image[j * w * 3 + i] - reference[j * w * 3 + i];
+				sum += d * d;
+			}
+		}
+		int in_region = pic.samples[Picture_index(&pic, (x0 + x1) / 2, (y0 + y1) / 2)];
+		printf("\t%-20s %.4f, %d samples per pixel in the region\r\n", focused ? "foveated" : "whole picture", sqrt(sum / ((x1 - x0) * (y1 - y0) * 3)), in_region);
+		Picture_free(&pic);
+	}
+	render_focus = old_focus;
+
+	Alloc_free(reference);
+	Alloc_free(image);
+	Sampler_free(&sampler);
+	HittableList_free(&world);
+}
+
+#endif
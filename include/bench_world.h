@@ -0,0 +1,109 @@
+#ifndef BENCH_WORLD
+#define BENCH_WORLD
+#include "bench_fixture.h"
+#include "vec3.h"
+#include "world.h"
+#include "hittable_list.h"
+#include "scenes.h"
+
+// vector math and ray queries against the scenes
+
+static Vector3 bench_a3[BENCH_N], bench_b3[BENCH_N], bench_out3[BENCH_N];
+static Vec3 bench_av[BENCH_N], bench_bv[BENCH_N], bench_outv[BENCH_N];
+static float bench_outf[BENCH_N];
+static bool bench_outb[BENCH_N];
+
+void bench_vec3() {
+	printf("vector kernels (raymath Vector3 vs Vec3, %s backend):\r\n",
+#ifdef VEC3_SSE
+		"SSE"
+#else
+		"scalar"
+#endif
+	);
+
+	for (int i = 0; i < BENCH_N; i++) {
+		bench_av[i] = Vec3RandRange(-1, 1);
+		bench_bv[i] = UnitVector(Vec3RandRange(-1, 1));
+		bench_a3[i] = Vec3ToVector3(bench_av[i]);
+		bench_b3[i] = Vec3ToVector3(bench_bv[i]);
+	}
+
+	BENCH_LOOP("Vector3Add", BENCH_REPS, bench_out3[i] = Vector3Add(bench_a3[i], bench_b3[i]));
+	BENCH_LOOP("Vec3Add", BENCH_REPS, bench_outv[i] = Vec3Add(bench_av[i], bench_bv[i]));
+	BENCH_LOOP("Vector3Scale", BENCH_REPS, bench_out3[i] = Vector3Scale(bench_a3[i], 0.5f));
+	BENCH_LOOP("Vec3Scale", BENCH_REPS, bench_outv[i] = Vec3Scale(bench_av[i], 0.5f));
+	BENCH_LOOP("Vector3Multiply", BENCH_REPS, bench_out3[i] = Vector3Multiply(bench_a3[i], bench_b3[i]));
+	BENCH_LOOP("Vec3Multiply", BENCH_REPS, bench_outv[i] = Vec3Multiply(bench_av[i], bench_bv[i]));
+	BENCH_LOOP("Vector3DotProduct", BENCH_REPS, bench_outf[i] = Vector3DotProduct(bench_a3[i], bench_b3[i]));
+	BENCH_LOOP("Vec3DotProduct", BENCH_REPS, bench_outf[i] = Vec3DotProduct(bench_av[i], bench_bv[i]));
+	BENCH_LOOP("Vector3CrossProduct", BENCH_REPS, bench_out3[i] = Vector3CrossProduct(bench_a3[i], bench_b3[i]));
+	BENCH_LOOP("Vec3CrossProduct", BENCH_REPS, bench_outv[i] = Vec3CrossProduct(bench_av[i], bench_bv[i]));
+	BENCH_LOOP("Vector3Length", BENCH_REPS, bench_outf[i] = Vector3Length(bench_a3[i]));
+	BENCH_LOOP("Vec3Length", BENCH_REPS, bench_outf[i] = Vec3Length(bench_av[i]));
+	BENCH_LOOP("Vector3Normalize", BENCH_REPS, bench_out3[i] = Vector3Normalize(bench_a3[i]));
+	BENCH_LOOP("Vec3Normalize", BENCH_REPS, bench_outv[i] = Vec3Normalize(bench_av[i]));
+	BENCH_LOOP("Vector3Reflect", BENCH_REPS, bench_out3[i] = Vector3Reflect(bench_a3[i], bench_b3[i]));
+	BENCH_LOOP("Vec3Reflect", BENCH_REPS, bench_outv[i] = Vec3Reflect(bench_av[i], bench_bv[i]));
+
+	printf("intersection kernels:\r\n");
+
+	HitRecord rec;
+	HittableObject sphere = MakeSphere(point3(0, 0, 0), 0.5, 0).object;
+	HittableObject box = MakeAabb(point3(-0.5, -0.5, -0.5), point3(0.5, 0.5, 0.5)).object;
+
+	// rays from random points in [-1,1]^3 in random directions; roughly half of them hit
+	BENCH_LOOP("Sphere_hit", BENCH_REPS, bench_outb[i] = Sphere_hit(sphere, ray(bench_av[i], bench_bv[i]), 0.001, INFINITY, &rec));
+	BENCH_LOOP("Aabb_hit", BENCH_REPS, bench_outb[i] = Aabb_hit(box, ray(bench_av[i], bench_bv[i]), 0.001, INFINITY, &rec));
+
+	// keep the compiler from throwing the loops away
+	float checksum = 0;
+	for (int i = 0; i < BENCH_N; i++) {
+		checksum += bench_out3[i].x + bench_outv[i].x + bench_outf[i] + bench_outb[i];
+	}
+	printf("\t(checksum %f)\r\n", checksum);
+}
+
+static Ray3 bench_rays[BENCH_N];
+static double bench_tmax[BENCH_N];
+
+// shadow-ray-like queries: from whatever a camera ray hits first towards a random point around what the camera looks at
+void bench_occlusion_scene(const char* name, HittableList world) {
+	Camera_update(&(world.camera), world.camera.origin, world.camera.lookat, world.camera.vup, world.camera.vfov, world.camera.aperture, world.camera.focus_dist, 640, 480);
+
+	int n = 0;
+	for (int attempt = 0; n < BENCH_N && attempt < 100 * BENCH_N; attempt++) {
+		HitRecord rec;
+		Ray3 r = Camera_getRay(world.camera, random_double1(), random_double1(), random_double1(), random_double1());
+		if (!HittableList_hit(&world, r, 0.001, INFINITY, &rec)) continue;
+
+		Vec3 target = Vec3Add(world.camera.lookat, Vec3RandRange(-2, 2));
+		bench_rays[n] = ray(rec.p, Vec3Subtract(target, rec.p));
+		bench_tmax[n] = 1.0;
+		n++;
+	}
+	if (n < BENCH_N) {
+		printf("%s: camera doesn't see anything, skipping\r\n", name);
+		HittableList_free(&world);
+		return;
+	}
+
+	printf("%s (%d objects):\r\n", name, world.len);
+	HitRecord rec;
+	BENCH_LOOP("HittableList_hit", 50, bench_outb[i] = HittableList_hit(&world, bench_rays[i], 0.001, bench_tmax[i], &rec));
+	BENCH_LOOP("HittableList_occluded", 50, bench_outb[i] = HittableList_occluded(&world, bench_rays[i], 0.001, bench_tmax[i]));
+
+	int blocked = 0;
+	for (int i = 0; i < BENCH_N; i++) blocked += bench_outb[i];
+	printf("\t(%d%% of rays blocked)\r\n", blocked * 100 / BENCH_N);
+	HittableList_free(&world);
+}
+
+void bench_occlusion() {
+	printf("occlusion queries vs closest hit:\r\n");
+	bench_occlusion_scene("sexy_scene", sexy_scene());
+	bench_occlusion_scene("random_scene", random_scene());
+	bench_occlusion_scene("bright_light_scene", bright_light_scene());
+}
+
+#endif
@@ -10,32 +10,47 @@
 #include "utils.h"
 
 typedef struct {
-	Vector3 origin;
-	Vector3 lower_left_corner;
-	Vector3 horizontal;
-	Vector3 vertical;
-	Vector3 lookat;
-	Vector3 vup;
+	Vec3 origin;
+	Vec3 lower_left_corner;
+	Vec3 horizontal;
+	Vec3 vertical;
+	Vec3 lookat;
+	Vec3 vup;
 	double vfov;
 	double aperture;
 	double focus_dist;
-	Vector3 u, v, w;
+	Vec3 u, v, w;
 	double lens_radius;
 } Cam;
 
-Ray Camera_getRay(Cam c, double s, double t) {
-	Vector3 rd = Vector3Scale(random_in_unit_disk(), c.lens_radius);
-	Vector3 offset = Vector3Add(Vector3Scale(c.u, rd.x), Vector3Scale(c.v, rd.y));
+// s, t pick the point on screen and lens_u, lens_v the point on the lens, all in [0,1)
+Ray3 Camera_getRay(Cam c, double s, double t, double lens_u, double lens_v) {
+	Vec3 rd = Vec3Scale(sample_concentric_disk(lens_u, lens_v), c.lens_radius);
+	Vec3 offset = Vec3Add(Vec3Scale(c.u, rd.x), Vec3Scale(c.v, rd.y));
 
-	Vector3 ray_direction = Vector3Add(c.lower_left_corner, Vector3Scale(c.horizontal, s));
-	ray_direction = Vector3Add(ray_direction, Vector3Scale(c.vertical, t));
-	ray_direction = Vector3Subtract(ray_direction, c.origin);
-	ray_direction = Vector3Subtract(ray_direction, offset);
+	Vec3 ray_direction = Vec3Add(c.lower_left_corner, Vec3Scale(c.horizontal, s));
+	ray_direction = Vec3Add(ray_direction, Vec3Scale(c.vertical, t));
+	ray_direction = Vec3Subtract(ray_direction, c.origin);
+	ray_direction = Vec3Subtract(ray_direction, offset);
 
-	return ray(Vector3Add(c.origin, offset), ray_direction);
+	return ray(Vec3Add(c.origin, offset), ray_direction);
 }
 
-void Camera_update(Cam *c, Vector3 origin, Vector3 lookat, Vector3 vup, double vfov, double aperture, double focus_dist, int image_width, int image_height) {
+// inverse of Camera_getRay through the lens center: finds the s, t whose ray passes through p.
+// false if p is behind the camera
+bool Camera_project(Cam c, Vec3 p, double* s, double* t) {
+	Vec3 d = Vec3Subtract(p, c.origin);
+	double z = -Vec3DotProduct(d, c.w);
+	if (z <= 1e-6) return false;
+
+	Vec3 on_plane = Vec3Add(c.origin, Vec3Scale(d, c.focus_dist / z));
+	Vec3 rel = Vec3Subtract(on_plane, c.lower_left_corner);
+	*s = Vec3DotProduct(rel, c.u) / Vec3Length(c.horizontal);
+	*t = Vec3DotProduct(rel, c.v) / Vec3Length(c.vertical);
+	return true;
+}
+
+void Camera_update(Cam *c, Vec3 origin, Vec3 lookat, Vec3 vup, double vfov, double aperture, double focus_dist, int image_width, int image_height) {
 	double theta = degrees_to_radians(vfov);
 	double h = tan(theta / 2);
 
@@ -49,23 +64,23 @@ void Camera_update(Cam *c, Vector3 origin, Vector3 lookat, Vector3 vup, double v
 	c->focus_dist = focus_dist;
 	c->aperture = aperture;
 
-	c->w = UnitVector(Vector3Subtract(origin, lookat));
-	c->u = UnitVector(Vector3CrossProduct(vup, c->w));
-	c->v = Vector3CrossProduct(c->w, c->u);
+	c->w = UnitVector(Vec3Subtract(origin, lookat));
+	c->u = UnitVector(Vec3CrossProduct(vup, c->w));
+	c->v = Vec3CrossProduct(c->w, c->u);
 
-	c->horizontal = Vector3Scale(c->u, viewport_width * focus_dist);
-	c->vertical = Vector3Scale(c->v, viewport_height * focus_dist);
+	c->horizontal = Vec3Scale(c->u, viewport_width * focus_dist);
+	c->vertical = Vec3Scale(c->v, viewport_height * focus_dist);
 	c->vfov = vfov;
 
-	c->lower_left_corner = Vector3Subtract(
-		Vector3Subtract(c->origin, Vector3Scale(c->horizontal, 0.5)),
-		Vector3Subtract(Vector3Scale(c->vertical, 0.5), Vector3Scale(c->w, -focus_dist))
+	c->lower_left_corner = Vec3Subtract(
+		Vec3Subtract(c->origin, Vec3Scale(c->horizontal, 0.5)),
+		Vec3Subtract(Vec3Scale(c->vertical, 0.5), Vec3Scale(c->w, -focus_dist))
 	);
 
 	c->lens_radius = aperture / 2;
 }
 
-Cam MakeCamera(Vector3 origin, Vector3 lookat, Vector3 vup, double vfov, double aperture, double focus_dist, int image_width, int image_height) {
+Cam MakeCamera(Vec3 origin, Vec3 lookat, Vec3 vup, double vfov, double aperture, double focus_dist, int image_width, int image_height) {
 	Cam c;
 
 	Camera_update(&c, origin, lookat, vup, vfov, aperture, focus_dist, image_width, image_height);
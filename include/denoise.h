@@ -0,0 +1,535 @@
+#ifndef DENOISE
+#define DENOISE
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include "utils.h"
+#include "alloc.h"
+#include "picture.h"
+#include "render.h"
+#include "jobs.h"
+
+// edge-avoiding a-trous wavelet filter (dammertz et al. 2010), guided by the first hit albedo, normal and depth
+// the picture keeps, with the color weight scaled by each pixel's variance like in SVGF.
+// lighting is filtered separately from albedo (color / albedo, filtered, then * albedo again) so the filter can't
+// blur material edges, only noise in the lighting
+//
+// the temporal half of SVGF (schied et al. 2017) happens in the picture: after a camera move it starts out with
+// the old picture reprojected into the new view (Picture_reproject), so while moving at 1 spp the filter sees
+// pixels worth several samples, and only has to estimate variance spatially where the history got rejected
+
+#define DENOISE_MAX_ITERATIONS 5
+
+#ifdef VEC3_SSE
+#include <emmintrin.h>
+#endif
+
+// everything the filter reads per tap is in planes of floats (one per channel), so 4 neighbouring pixels load with
+// one instruction each and Denoiser_filterRow does 4 pixels at a time. at 1080p that's still ~250M taps per run, so
+// the denoiser only reruns at convergence steps (see Denoiser_wanted), not every time the picture gets samples.
+// the main loop has the render thread run it a band of rows at a time (see Denoiser_step), so neither the ui nor
+// a camera move ever waits for a whole run, and output keeps the last result until the next one is done
+typedef struct {
+	int width, height;
+	int capacity; // pixels the buffers have room for
+	float* illum[2][3]; // ping-pong planes of demodulated color, r g b
+	float* lum[2]; // luminance of illum, so the filter doesn't recompute it 25 times per pixel
+	float* variance[2]; // luminance variance of illum, filtered along with it
+	float* normal[3];
+	float* depth;
+	float* moment; // mean squared luminance of illum and how many samples it's from, for the variance estimate
+	float* len;
+	Vec3* albedo;
+	Vec3* output; // row-major, top row first like the picture's v = height - 1
+	int output_width, output_height; // what output is the size of, 0 before the first run
+	unsigned output_generation; // pic->generation output was made from, see Denoiser_shows
+
+	int iterations; // each one doubles the filter's reach: 4 iterations cover a 61 pixel wide area, 5 (the most) 125
+	float sigma_luminance; // how many standard deviations of difference in lighting still get blended
+	float sigma_depth; // allowed relative depth change per pixel of distance
+
+	// the run in progress, or the last one. it works from what the picture was like when it started
+	long long denoised_at; // pic->samples_traced, so a finished picture isn't redone every frame
+	int denoised_passes; // pic->sample_count, -1 if invalidated since
+	unsigned denoised_generation; // pic->generation, it's a different picture if that changed
+	int runs; // counts up whenever output changes, so the display knows when it has to convert it again
+
+	// state for the row jobs, and how far the run in progress got: which of its passes over the rows (see
+	// Denoiser_bandRow) and which row of it is next
+	Picture* pic;
+	int step;
+	int src;
+	int stage;
+	int next_row;
+} Denoiser;
+
+// the passes over the rows a run makes, in order: one DENOISE_FILTER per iteration, then the finishing one
+enum { DENOISE_IDLE, DENOISE_PREPARE, DENOISE_VARIANCE, DENOISE_FILTER };
+
+// rows Denoiser_step does between looking for something more urgent
+#define DENOISE_BAND 16
+
+Denoiser MakeDenoiser() {
+	Denoiser d = {0};
+	d.iterations = 4;
+	d.sigma_luminance = 4.0f;
+	d.sigma_depth = 0.02f;
+	d.denoised_at = -1;
+	d.denoised_passes = -1;
+	return d;
+}
+
+// every float plane, for allocating and freeing them all the same way
+#define DENOISE_PLANES 16
+static inline float** Denoiser_plane(Denoiser* d, int i) {
+	if (i < 6) return &(d->illum[i / 3][i % 3]);
+	if (i < 8) return &(d->lum[i - 6]);
+	if (i < 10) return &(d->variance[i - 8]);
+	if (i < 13) return &(d->normal[i - 10]);
+	if (i == 13) return &(d->depth);
+	return i == 14 ? &(d->moment) : &(d->len);
+}
+
+void Denoiser_free(Denoiser* d) {
+	for (int i = 0; i < DENOISE_PLANES; i++) {
+		Alloc_free(*Denoiser_plane(d, i));
+		*Denoiser_plane(d, i) = NULL;
+	}
+	Alloc_free(d->albedo);
+	Alloc_free(d->output);
+	d->albedo = d->output = NULL;
+	d->width = d->height = 0;
+	d->output_width = d->output_height = 0;
+	d->capacity = 0;
+	d->denoised_at = -1;
+	d->denoised_passes = -1;
+	d->stage = DENOISE_IDLE;
+}
+
+// only allocates when the picture outgrows the buffers, so the smaller pictures rendered while the camera moves
+// reuse the full size ones. output stays as it is until the next run finishes, if the buffers didn't have to grow
+void Denoiser_resize(Denoiser* d, int width, int height) {
+	if (d->width == width && d->height == height) return;
+	int n = width * height;
+	if (n <= d->capacity) {
+		d->width = width;
+		d->height = height;
+		d->denoised_at = -1;
+		d->denoised_passes = -1;
+		return;
+	}
+	Denoiser_free(d);
+
+	d->width = width;
+	d->height = height;
+	d->capacity = n;
+	for (int i = 0; i < DENOISE_PLANES; i++) {
+		*Denoiser_plane(d, i) = (float*)Alloc_malloc(n * sizeof(float));
+	}
+	d->albedo = (Vec3*)Alloc_malloc(n * sizeof(Vec3));
+	d->output = (Vec3*)Alloc_malloc(n * sizeof(Vec3));
+}
+
+// call when output should be redone even though the picture hasn't changed (the settings did, or it was off). drops
+// the run in progress
+void Denoiser_invalidate(Denoiser* d) {
+	d->denoised_at = -1;
+	d->denoised_passes = -1;
+	d->stage = DENOISE_IDLE;
+}
+
+// pulls the picture's averages into flat buffers and divides the albedo out
+void Denoiser_prepareRow(void* arg, int y) {
+	Denoiser* d = (Denoiser*)arg;
+	Picture* pic = d->pic;
+	int v = d->height - 1 - y;
+
+	for (int x = 0; x < d->width; x++) {
+		int p = y * d->width + x;
+		int su = x, sv = v;
+		Picture_previewSource(pic, &su, &sv);
+		Features f = Picture_features(pic, su, sv);
+		Vec3 albedo = Vec3Max(f.albedo, color(0.01, 0.01, 0.01));
+		double albedo_lum = luminance(albedo);
+		float n = Picture_weight(pic, su, sv);
+
+		Vec3 illum = Vec3Divide(Picture_mean(pic, su, sv), albedo);
+		for (int c = 0; c < 3; c++) {
+			d->illum[0][c][p] = illum.e[c];
+			d->normal[c][p] = f.normal.e[c];
+		}
+		d->lum[0][p] = luminance(illum);
+		d->moment[p] = n > 0 ? pic->lum_sq[Picture_index(pic, su, sv)] / (n * albedo_lum * albedo_lum) : 0;
+		d->len[p] = n;
+		d->albedo[p] = albedo;
+		d->depth[p] = f.depth;
+	}
+}
+
+static inline float Denoiser_normalDot(Denoiser* d, int p, int q) {
+	return d->normal[0][p] * d->normal[0][q] + d->normal[1][p] * d->normal[1][q] + d->normal[2][p] * d->normal[2][q];
+}
+
+// variance of each pixel's mean luminance from its moments. pixels with fewer than 4 samples (everything
+// at first, or where the history got rejected after a move) don't have enough of them, so their per-sample variance
+// is estimated from a 7x7 neighbourhood on the same surface instead
+void Denoiser_varianceRow(void* arg, int y) {
+	Denoiser* d = (Denoiser*)arg;
+	const int w = d->width;
+
+	for (int x = 0; x < w; x++) {
+		int p = y * w + x;
+		float len = d->len[p];
+		float l = d->lum[0][p];
+		float m1 = l, m2 = d->moment[p];
+
+		if (len < 4) {
+			bool sky = d->depth[p] == 0;
+			// the pixel itself always counts, even when its normal doesn't pass the test against itself (a zero
+			// normal does that), so there's never nothing to divide by
+			float weight_sum = 1;
+			for (int yy = y - 3; yy <= y + 3; yy++) {
+				if (yy < 0 || yy >= d->height) continue;
+				for (int xx = x - 3; xx <= x + 3; xx++) {
+					if (xx < 0 || xx >= w) continue;
+					int q = yy * w + xx;
+					if (q == p || sky != (d->depth[q] == 0)) continue;
+					if (!sky && Denoiser_normalDot(d, p, q) < 0.9f) continue;
+					m1 += d->lum[0][q];
+					m2 += d->moment[q];
+					weight_sum++;
+				}
+			}
+			m1 /= weight_sum;
+			m2 /= weight_sum;
+		}
+
+		d->variance[0][p] = len > 0 ? fmaxf(0.0f, m2 - m1 * m1) / len : 1e6f;
+	}
+}
+
+// x^128 with 7 multiplies instead of a powf
+float pow128(float x) {
+	for (int i = 0; i < 7; i++) x *= x;
+	return x;
+}
+
+// e^x for x <= 0, to about 1e-4 relative, which is plenty for a filter weight. libm's expf was most of the filter's
+// time. splits x / ln 2 into an integer part that goes straight into the exponent bits and a fraction that a cubic
+// turns into 2^f
+static inline float denoise_exp(float x) {
+	float t = fmaxf(x * 1.44269504f, -126.0f);
+	int i = (int)t;
+	if (i > t) i--; // floor, t is negative
+	float f = t - i;
+	float p = 1.0f + f * (0.69583356f + f * (0.22606716f + f * 0.07802452f));
+	union {float f; int i;} scale = {.i = (i + 127) << 23};
+	return p * scale.f;
+}
+
+// taps that would get less weight than this are left out, which changes nothing visible but keeps denormals out of
+// the sums, and the cpu handles those several times slower. the normal and color terms get cut off early for the
+// same reason: 0.9^128 and e^-20 are about as small as they can be before their product with the rest underflows
+#define DENOISE_MIN_WEIGHT 1e-6f
+#define DENOISE_MIN_DOT 0.9f
+#define DENOISE_MAX_EXPONENT 20.0f
+// variance shrinks with every iteration, so it gets a floor too. far below where it'd change the color weight
+#define DENOISE_MIN_VARIANCE 1e-14f
+
+// B3 spline, the usual a-trous kernel: 1/16 1/4 3/8 1/4 1/16
+static const float denoise_kernel[3] = {3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f};
+
+typedef struct {
+	const float* src[3];
+	const float* src_lum;
+	const float* src_var;
+	float* dst[3];
+	float* dst_lum;
+	float* dst_var;
+	float inv_distance[5][5]; // 1 / distance of every tap, for the depth term
+} DenoiseTaps;
+
+// filters pixel (x, y) into dst, for the pixels too close to the edge for Denoiser_filterRow's 4 at a time
+void Denoiser_filterPixel(Denoiser* d, DenoiseTaps* t, int x, int y) {
+	const int w = d->width;
+	const int step = d->step;
+	int p = y * w + x;
+	float z_p = d->depth[p];
+	bool sky_p = z_p == 0;
+	float l_p = t->src_lum[p];
+	float inv_sigma_l = 1.0f / (d->sigma_luminance * sqrtf(t->src_var[p]) + 1e-6f);
+	float inv_sigma_z = 1.0f / (d->sigma_depth * z_p + 1e-6f);
+
+	// the center tap is the same surface and lighting as itself, so it's just the kernel weight
+	float weight_sum = denoise_kernel[0] * denoise_kernel[0];
+	float sum[3];
+	for (int c = 0; c < 3; c++) sum[c] = t->src[c][p] * weight_sum;
+	float variance_sum = weight_sum * weight_sum * t->src_var[p];
+
+	for (int dy = -2; dy <= 2; dy++) {
+		int yy = y + dy * step;
+		if (yy < 0 || yy >= d->height) continue;
+
+		for (int dx = -2; dx <= 2; dx++) {
+			int xx = x + dx * step;
+			if (xx < 0 || xx >= w || (dx == 0 && dy == 0)) continue;
+
+			int q = yy * w + xx;
+			float z_q = d->depth[q];
+			if (sky_p != (z_q == 0)) continue;
+
+			float weight = denoise_kernel[abs(dx)] * denoise_kernel[abs(dy)];
+			float exponent = fabsf(l_p - t->src_lum[q]) * inv_sigma_l;
+			if (!sky_p) {
+				float dot = Denoiser_normalDot(d, p, q);
+				if (dot < DENOISE_MIN_DOT) continue;
+				weight *= pow128(dot);
+				exponent += fabsf(z_p - z_q) * inv_sigma_z * t->inv_distance[dy + 2][dx + 2];
+			}
+			weight *= denoise_exp(-fminf(exponent, DENOISE_MAX_EXPONENT));
+			if (weight < DENOISE_MIN_WEIGHT) continue;
+
+			for (int c = 0; c < 3; c++) sum[c] += t->src[c][q] * weight;
+			weight_sum += weight;
+			variance_sum += weight * weight * t->src_var[q];
+		}
+	}
+
+	for (int c = 0; c < 3; c++) t->dst[c][p] = sum[c] / weight_sum;
+	t->dst_lum[p] = 0.2126f * t->dst[0][p] + 0.7152f * t->dst[1][p] + 0.0722f * t->dst[2][p];
+	t->dst_var[p] = fmaxf(variance_sum / (weight_sum * weight_sum), DENOISE_MIN_VARIANCE);
+}
+
+#ifdef VEC3_SSE
+// denoise_exp for 4 lanes. sse2 has no floor, but x <= 0 so truncating and stepping down where that rounded up works
+static inline __m128 denoise_exp4(__m128 x) {
+	__m128 t = _mm_max_ps(_mm_mul_ps(x, _mm_set1_ps(1.44269504f)), _mm_set1_ps(-126.0f));
+	__m128i i = _mm_cvttps_epi32(t);
+	__m128 fi = _mm_cvtepi32_ps(i);
+	__m128 rounded_up = _mm_cmpgt_ps(fi, t);
+	i = _mm_add_epi32(i, _mm_castps_si128(rounded_up)); // the mask is -1 where it rounded up
+	fi = _mm_sub_ps(fi, _mm_and_ps(rounded_up, _mm_set1_ps(1.0f)));
+	__m128 f = _mm_sub_ps(t, fi);
+
+	__m128 p = _mm_add_ps(_mm_mul_ps(f, _mm_set1_ps(0.07802452f)), _mm_set1_ps(0.22606716f));
+	p = _mm_add_ps(_mm_mul_ps(f, p), _mm_set1_ps(0.69583356f));
+	p = _mm_add_ps(_mm_mul_ps(f, p), _mm_set1_ps(1.0f));
+	__m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(i, _mm_set1_epi32(127)), 23));
+	return _mm_mul_ps(p, scale);
+}
+
+// Denoiser_filterPixel for x .. x + 3, which all need to have every tap inside the row
+void Denoiser_filter4(Denoiser* d, DenoiseTaps* t, int x, int y) {
+	const int w = d->width;
+	const int step = d->step;
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	int p = y * w + x;
+
+	__m128 n_p[3];
+	for (int c = 0; c < 3; c++) n_p[c] = _mm_loadu_ps(d->normal[c] + p);
+	__m128 z_p = _mm_loadu_ps(d->depth + p);
+	__m128 sky_p = _mm_cmpeq_ps(z_p, zero);
+	__m128 l_p = _mm_loadu_ps(t->src_lum + p);
+	__m128 var_p = _mm_loadu_ps(t->src_var + p);
+	__m128 inv_sigma_l = _mm_div_ps(one, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(d->sigma_luminance), _mm_sqrt_ps(var_p)), _mm_set1_ps(1e-6f)));
+	__m128 inv_sigma_z = _mm_div_ps(one, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(d->sigma_depth), z_p), _mm_set1_ps(1e-6f)));
+
+	__m128 weight_sum = _mm_set1_ps(denoise_kernel[0] * denoise_kernel[0]);
+	__m128 sum[3];
+	for (int c = 0; c < 3; c++) sum[c] = _mm_mul_ps(_mm_loadu_ps(t->src[c] + p), weight_sum);
+	__m128 variance_sum = _mm_mul_ps(_mm_mul_ps(weight_sum, weight_sum), var_p);
+
+	for (int dy = -2; dy <= 2; dy++) {
+		int yy = y + dy * step;
+		if (yy < 0 || yy >= d->height) continue;
+
+		for (int dx = -2; dx <= 2; dx++) {
+			if (dx == 0 && dy == 0) continue;
+			int q = yy * w + x + dx * step;
+
+			__m128 z_q = _mm_loadu_ps(d->depth + q);
+			__m128 other_surface = _mm_xor_ps(sky_p, _mm_cmpeq_ps(z_q, zero));
+
+			__m128 dot = _mm_mul_ps(n_p[0], _mm_loadu_ps(d->normal[0] + q));
+			dot = _mm_add_ps(dot, _mm_mul_ps(n_p[1], _mm_loadu_ps(d->normal[1] + q)));
+			dot = _mm_add_ps(dot, _mm_mul_ps(n_p[2], _mm_loadu_ps(d->normal[2] + q)));
+			dot = _mm_and_ps(_mm_cmpge_ps(dot, _mm_set1_ps(DENOISE_MIN_DOT)), dot);
+			for (int i = 0; i < 7; i++) dot = _mm_mul_ps(dot, dot);
+			// sky has no normal to compare
+			__m128 normal_weight = _mm_or_ps(_mm_and_ps(sky_p, one), _mm_andnot_ps(sky_p, dot));
+
+			__m128 l_q = _mm_loadu_ps(t->src_lum + q);
+			__m128 exponent = _mm_mul_ps(_mm_andnot_ps(sign, _mm_sub_ps(l_p, l_q)), inv_sigma_l);
+			// 0 for sky, whose depth is 0
+			__m128 depth_term = _mm_mul_ps(_mm_andnot_ps(sign, _mm_sub_ps(z_p, z_q)), inv_sigma_z);
+			exponent = _mm_add_ps(exponent, _mm_mul_ps(depth_term, _mm_set1_ps(t->inv_distance[dy + 2][dx + 2])));
+
+			__m128 weight = _mm_mul_ps(_mm_set1_ps(denoise_kernel[abs(dx)] * denoise_kernel[abs(dy)]), normal_weight);
+			weight = _mm_mul_ps(weight, denoise_exp4(_mm_sub_ps(zero, _mm_min_ps(exponent, _mm_set1_ps(DENOISE_MAX_EXPONENT)))));
+			__m128 left_out = _mm_or_ps(other_surface, _mm_cmplt_ps(weight, _mm_set1_ps(DENOISE_MIN_WEIGHT)));
+			weight = _mm_andnot_ps(left_out, weight);
+
+			for (int c = 0; c < 3; c++) sum[c] = _mm_add_ps(sum[c], _mm_mul_ps(_mm_loadu_ps(t->src[c] + q), weight));
+			weight_sum = _mm_add_ps(weight_sum, weight);
+			variance_sum = _mm_add_ps(variance_sum, _mm_mul_ps(_mm_mul_ps(weight, weight), _mm_loadu_ps(t->src_var + q)));
+		}
+	}
+
+	__m128 inv_weight = _mm_div_ps(one, weight_sum);
+	for (int c = 0; c < 3; c++) {
+		sum[c] = _mm_mul_ps(sum[c], inv_weight);
+		_mm_storeu_ps(t->dst[c] + p, sum[c]);
+	}
+	__m128 lum = _mm_mul_ps(sum[0], _mm_set1_ps(0.2126f));
+	lum = _mm_add_ps(lum, _mm_mul_ps(sum[1], _mm_set1_ps(0.7152f)));
+	lum = _mm_add_ps(lum, _mm_mul_ps(sum[2], _mm_set1_ps(0.0722f)));
+	_mm_storeu_ps(t->dst_lum + p, lum);
+	__m128 variance = _mm_mul_ps(variance_sum, _mm_mul_ps(inv_weight, inv_weight));
+	_mm_storeu_ps(t->dst_var + p, _mm_max_ps(variance, _mm_set1_ps(DENOISE_MIN_VARIANCE)));
+}
+#endif
+
+void Denoiser_filterRow(void* arg, int y) {
+	Denoiser* d = (Denoiser*)arg;
+	const int w = d->width;
+	const int step = d->step;
+
+	DenoiseTaps t;
+	for (int c = 0; c < 3; c++) {
+		t.src[c] = d->illum[d->src][c];
+		t.dst[c] = d->illum[!d->src][c];
+	}
+	t.src_lum = d->lum[d->src];
+	t.src_var = d->variance[d->src];
+	t.dst_lum = d->lum[!d->src];
+	t.dst_var = d->variance[!d->src];
+	for (int dy = -2; dy <= 2; dy++) {
+		for (int dx = -2; dx <= 2; dx++) {
+			t.inv_distance[dy + 2][dx + 2] = (dx == 0 && dy == 0) ? 0 : 1.0f / (step * sqrtf((float)(dx * dx + dy * dy)));
+		}
+	}
+
+	int x = 0;
+#ifdef VEC3_SSE
+	// pixels whose taps are all inside the row go 4 at a time
+	for (; x < 2 * step && x < w; x++) Denoiser_filterPixel(d, &t, x, y);
+	for (; x + 3 + 2 * step < w; x += 4) Denoiser_filter4(d, &t, x, y);
+#endif
+	for (; x < w; x++) Denoiser_filterPixel(d, &t, x, y);
+}
+
+void Denoiser_finishRow(void* arg, int y) {
+	Denoiser* d = (Denoiser*)arg;
+	for (int x = 0; x < d->width; x++) {
+		int p = y * d->width + x;
+		Vec3 illum = color(d->illum[d->src][0][p], d->illum[d->src][1][p], d->illum[d->src][2][p]);
+		d->output[p] = Vec3Multiply(illum, d->albedo[p]);
+	}
+}
+
+// whether the picture changed enough since the last run to be worth another. the filter takes a while on a big
+// picture, so while the picture converges it only reruns when the sample count has doubled, and once more when
+// it's done. a picture gets its first once it has a whole pass, so the ones replaced before that (while the camera
+// keeps moving) aren't denoised at all
+bool Denoiser_wanted(Denoiser* d, Picture* pic) {
+	if (pic->sample_count == 0) return false;
+	if (d->denoised_generation != pic->generation) return true;
+	if (d->denoised_at == pic->samples_traced) return false; // nothing new
+	if (d->denoised_passes < 0) return true;
+	if (render_done(pic)) return true;
+	return pic->sample_count >= (d->denoised_passes > 0 ? 2 * d->denoised_passes : 1);
+}
+
+// starts a run on the picture as it is now, for Denoiser_step to work through
+void Denoiser_start(Denoiser* d, Picture* pic) {
+	Denoiser_resize(d, pic->width, pic->height);
+	d->denoised_at = pic->samples_traced;
+	d->denoised_passes = pic->sample_count;
+	d->denoised_generation = pic->generation;
+	d->pic = pic;
+	d->src = 0;
+	d->stage = DENOISE_PREPARE;
+	d->next_row = 0;
+}
+
+static inline int Denoiser_iterationCount(Denoiser* d) {
+	return d->iterations < DENOISE_MAX_ITERATIONS ? d->iterations : DENOISE_MAX_ITERATIONS;
+}
+
+// row d->next_row + i of the pass in progress. everything after the first pass only reads the denoiser's own
+// planes, so the picture can go on getting samples while the rest of the run happens
+void Denoiser_bandRow(void* arg, int i) {
+	Denoiser* d = (Denoiser*)arg;
+	int y = d->next_row + i;
+	if (d->stage == DENOISE_PREPARE) Denoiser_prepareRow(d, y);
+	else if (d->stage == DENOISE_VARIANCE) Denoiser_varianceRow(d, y);
+	else Denoiser_filterRow(d, y);
+}
+
+// works on the run in progress for about budget seconds, a band of rows at a time, stopping early when the ui
+// wants in (see render_preempted). the first band always goes. true once the run is done and output has the
+// result. a run on a picture that got replaced in the meantime is dropped
+bool Denoiser_step(Denoiser* d, Picture* pic, double budget) {
+	if (d->stage == DENOISE_IDLE) return false;
+	if (pic->generation != d->denoised_generation || pic->width != d->width || pic->height != d->height) {
+		d->stage = DENOISE_IDLE;
+		return false;
+	}
+
+	double start = render_now();
+	int finish = DENOISE_FILTER + Denoiser_iterationCount(d);
+	do {
+		if (d->stage == finish) {
+			// cheap, so it goes in one go and the display never sees half of it
+			Jobs_parallelFor(d->height, Denoiser_finishRow, d);
+			d->output_width = d->width;
+			d->output_height = d->height;
+			d->output_generation = d->denoised_generation;
+			d->stage = DENOISE_IDLE;
+			d->runs++;
+			return true;
+		}
+
+		int rows = d->height - d->next_row < DENOISE_BAND ? d->height - d->next_row : DENOISE_BAND;
+		if (d->stage >= DENOISE_FILTER) {
+			d->step = 1 << (d->stage - DENOISE_FILTER);
+		}
+		Jobs_parallelFor(rows, Denoiser_bandRow, d);
+		d->next_row += rows;
+		if (d->next_row == d->height) {
+			if (d->stage >= DENOISE_FILTER) d->src = !d->src;
+			d->next_row = 0;
+			d->stage++;
+		}
+	} while (render_now() - start < budget && !render_preempted());
+	return false;
+}
+
+// whether there's a run in progress, or one due
+bool Denoiser_pending(Denoiser* d, Picture* pic) {
+	return d->stage != DENOISE_IDLE || Denoiser_wanted(d, pic);
+}
+
+// denoises the picture's current state into d->output all at once, if Denoiser_wanted says so. true if output
+// changed
+bool Denoiser_run(Denoiser* d, Picture* pic) {
+	if (!Denoiser_wanted(d, pic)) return false;
+	Denoiser_start(d, pic);
+	while (d->stage != DENOISE_IDLE) {
+		Denoiser_step(d, pic, INFINITY);
+	}
+	return true;
+}
+
+// whether output is of the picture as it is now, size and all, rather than of one it replaced
+bool Denoiser_shows(Denoiser* d, Picture* pic) {
+	return d->output_generation == pic->generation && d->output_width == pic->width && d->output_height == pic->height;
+}
+
+Vec3 Denoiser_at(Denoiser* d, int x, int y) {
+	return d->output[y * d->width + x];
+}
+
+#endif
@@ -0,0 +1,286 @@
+#ifndef DISPLAY
+#define DISPLAY
+#include "raylib.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "utils.h"
+#include "alloc.h"
+#include "picture.h"
+#include "denoise.h"
+#include "tonemap.h"
+#include "jobs.h"
+
+// gets the picture on screen as one texture instead of a DrawPixel per pixel. only tiles that got new samples
+// are converted to 8 bit (in parallel, see tonemap.h) and uploaded, and when most of them did it's one
+// UpdateTexture for the whole thing.
+// the picture is rendered at a fixed size whatever the window's (smaller still while the camera moves, see
+// resolution.h), and gets scaled to fit the window on the cpu. resizing the window only changes the texture, the
+// picture keeps its samples
+
+typedef struct {
+	int width, height; // the picture's size
+	int out_width, out_height; // the texture's size
+	int tile_capacity; // the buffers below have room for a picture this many tiles big, so smaller ones reuse them
+	Texture2D texture;
+	Color* pixels; // the picture in 8 bit, row-major, top row first. what's in the texture unless it's upscaled
+	Color* upscaled; // out_width x out_height, when the picture isn't shown at its own size
+	int* columns; // picture column left of each window column, with the weight of the one right of it << 16
+	Color tile_pixels[TILE_SIZE * TILE_SIZE]; // one tile packed for UpdateTextureRec
+	bool loaded;
+	Denoiser* shown_denoiser; // what was shown last time; switching between raw and denoised redoes everything
+	Tonemap shown_tonemap; // same for exposure and tonemap operator
+	int shown_runs; // shown_denoiser->runs when its output was converted
+	long long tiles_uploaded; // stats
+
+	// state for the conversion jobs
+	Picture* pic;
+	Denoiser* denoiser;
+	int* tiles; // which tiles to convert
+	int tile_count;
+} Display;
+
+Display MakeDisplay() {
+	Display d = {0};
+	return d;
+}
+
+void Display_freeBuffers(Display* d) {
+	Alloc_free(d->pixels);
+	Alloc_free(d->upscaled);
+	Alloc_free(d->columns);
+	Alloc_free(d->tiles);
+	d->pixels = d->upscaled = NULL;
+	d->columns = NULL;
+	d->tiles = NULL;
+	d->tile_capacity = 0;
+	d->width = d->height = 0;
+	d->out_width = d->out_height = 0;
+}
+
+void Display_free(Display* d) {
+	if (d->loaded) {
+		UnloadTexture(d->texture);
+	}
+	d->loaded = false;
+	Display_freeBuffers(d);
+}
+
+bool Display_upscaling(Display* d) {
+	return d->width != d->out_width || d->height != d->out_height;
+}
+
+// switches to showing a width x height picture, which has to fit in the buffers
+void Display_setSize(Display* d, int width, int height) {
+	d->width = width;
+	d->height = height;
+	for (int x = 0; x < d->out_width; x++) {
+		float fx = fmaxf(0.0f, (x + 0.5f) * width / d->out_width - 0.5f);
+		d->columns[x] = (int)fx | (int)((fx - (int)fx) * 256) << 16;
+	}
+}
+
+// the cpu side buffers for showing a width x height picture in an out_width x out_height window. they're sized in
+// whole tiles and always include the ones for scaling, so the smaller pictures rendered while the camera moves
+// don't need new ones
+void Display_allocate(Display* d, int width, int height, int out_width, int out_height) {
+	d->out_width = out_width;
+	d->out_height = out_height;
+	d->tile_capacity = ((width + TILE_SIZE - 1) / TILE_SIZE) * ((height + TILE_SIZE - 1) / TILE_SIZE);
+	size_t n = (size_t)d->tile_capacity * TILE_SIZE * TILE_SIZE;
+	d->pixels = (Color*)Alloc_calloc(n, sizeof(Color));
+	d->tiles = (int*)Alloc_malloc(d->tile_capacity * sizeof(int));
+	d->upscaled = (Color*)Alloc_calloc(out_width * out_height, sizeof(Color));
+	d->columns = (int*)Alloc_malloc(out_width * sizeof(int));
+	Display_setSize(d, width, height);
+}
+
+// gets the cpu side ready for a width x height picture in an out_width x out_height window, allocating only if the
+// window changed or the picture outgrew the buffers. true if anything changed, so all of it needs converting again
+bool Display_reserve(Display* d, int width, int height, int out_width, int out_height) {
+	if (d->pixels != NULL && d->width == width && d->height == height && d->out_width == out_width && d->out_height == out_height) return false;
+
+	int tiles = ((width + TILE_SIZE - 1) / TILE_SIZE) * ((height + TILE_SIZE - 1) / TILE_SIZE);
+	if (d->pixels == NULL || out_width != d->out_width || out_height != d->out_height || tiles > d->tile_capacity) {
+		Display_freeBuffers(d);
+		Display_allocate(d, width, height, out_width, out_height);
+	}
+	else {
+		Display_setSize(d, width, height);
+	}
+	return true;
+}
+
+// returns true if the picture or the window changed size, which means all of it needs to be filled in again. the
+// texture is the window's size, so it's only remade when that changes
+bool Display_resize(Display* d, int width, int height, int out_width, int out_height) {
+	bool remake = !d->loaded || out_width != d->out_width || out_height != d->out_height;
+	bool changed = Display_reserve(d, width, height, out_width, out_height);
+	if (!remake) return changed;
+
+	if (d->loaded) {
+		UnloadTexture(d->texture);
+	}
+	Image image = {d->upscaled, out_width, out_height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+	d->texture = LoadTextureFromImage(image);
+	d->loaded = true;
+	return true;
+}
+
+// converts d->tiles[i] of the picture (or of the denoiser's output if there is one) into d->pixels
+void Display_convertTile(void* arg, int i) {
+	Display* d = (Display*)arg;
+	int x0, y0, x1, y1;
+	Picture_tileBounds(d->pic, d->tiles[i], &x0, &y0, &x1, &y1);
+	Vec3* sums = Picture_tile(d->pic, d->tiles[i]);
+
+	for (int v = y0; v < y1; v++) {
+		int y = d->height - 1 - v;
+		Color* row = d->pixels + y * d->width + x0;
+		if (d->denoiser != NULL) {
+			Tonemap_row(d->shown_tonemap, d->denoiser->output + y * d->width + x0, row, x1 - x0, false);
+		}
+		else if (Picture_previewStride(d->pic) > 1) {
+			// untraced pixels of a preview borrow their sum from the traced one next to them
+			Vec3 filled[TILE_SIZE];
+			for (int u = x0; u < x1; u++) {
+				int su = u, sv = v;
+				Picture_previewSource(d->pic, &su, &sv);
+				filled[u - x0] = d->pic->color[Picture_index(d->pic, su, sv)];
+			}
+			Tonemap_row(d->shown_tonemap, filled, row, x1 - x0, true);
+		}
+		else {
+			Tonemap_row(d->shown_tonemap, sums + (v - y0) * TILE_SIZE, row, x1 - x0, true);
+		}
+	}
+}
+
+// fills row y of d->upscaled. each window pixel blends the 4 picture pixels around it bilinearly. weighting
+// them by which surface they're on (the first hits are known) only made it worse: at picture resolution there's
+// no telling which side of an edge a window pixel is on, and the antialiased edges in the picture are a blend
+// already.
+// weights are 8 bit fixed point adding up to 256, so red and blue (and green and alpha) can be blended with
+// one multiply per tap without overflowing into each other.
+// a window smaller than the picture works the same way, down to half size without skipping any pixels
+void Display_upscaleRow(void* arg, int y) {
+	Display* d = (Display*)arg;
+	const float scale_y = (float)d->height / d->out_height;
+
+	float fy = (y + 0.5f) * scale_y - 0.5f;
+	if (fy < 0) fy = 0;
+	int y0 = (int)fy;
+	int y1 = y0 + 1 < d->height ? y0 + 1 : y0;
+	int wy = (int)((fy - y0) * 256);
+	const uint32_t* row0 = (const uint32_t*)(d->pixels + y0 * d->width);
+	const uint32_t* row1 = (const uint32_t*)(d->pixels + y1 * d->width);
+
+	uint32_t* out = (uint32_t*)(d->upscaled + y * d->out_width);
+	for (int x = 0; x < d->out_width; x++) {
+		int x0 = d->columns[x] & 0xffff;
+		int wx = d->columns[x] >> 16;
+		int x1 = x0 + 1 < d->width ? x0 + 1 : x0;
+
+		uint32_t t0 = row0[x0], t1 = row0[x1], t2 = row1[x0], t3 = row1[x1];
+		// down to 8 bits, with the rounding error going to the last tap so they still add up to exactly 256
+		int w0 = ((256 - wx) * (256 - wy)) >> 8;
+		int w1 = (wx * (256 - wy)) >> 8;
+		int w2 = ((256 - wx) * wy) >> 8;
+		int w3 = 256 - w0 - w1 - w2;
+
+		uint32_t rb = (t0 & 0x00ff00ff) * w0 + (t1 & 0x00ff00ff) * w1 + (t2 & 0x00ff00ff) * w2 + (t3 & 0x00ff00ff) * w3;
+		uint32_t ga = ((t0 >> 8) & 0x00ff00ff) * w0 + ((t1 >> 8) & 0x00ff00ff) * w1 + ((t2 >> 8) & 0x00ff00ff) * w2 + ((t3 >> 8) & 0x00ff00ff) * w3;
+		out[x] = ((rb >> 8) & 0x00ff00ff) | (ga & 0xff00ff00);
+	}
+}
+
+void Display_uploadTile(Display* d, Picture* pic, int tile) {
+	int x0, y0, x1, y1;
+	Picture_tileBounds(pic, tile, &x0, &y0, &x1, &y1);
+	int w = x1 - x0;
+	int h = y1 - y0;
+
+	// texture rows are flipped, so the tile's top row is picture row y1 - 1
+	int top = d->height - y1;
+	for (int y = 0; y < h; y++) {
+		memcpy(d->tile_pixels + y * w, d->pixels + (top + y) * d->width + x0, w * sizeof(Color));
+	}
+	UpdateTextureRec(d->texture, (Rectangle){x0, top, w, h}, d->tile_pixels);
+}
+
+// the biggest rectangle with the picture's aspect ratio that fits in the window, centered
+Rectangle Display_fit(int width, int height, int window_width, int window_height) {
+	float scale = fminf((float)window_width / width, (float)window_height / height);
+	int w = (int)(width * scale + 0.5f);
+	int h = (int)(height * scale + 0.5f);
+	if (w < 1) w = 1;
+	if (h < 1) h = 1;
+	return (Rectangle){(window_width - w) / 2, (window_height - h) / 2, w, h};
+}
+
+// brings the texture up to date with the picture
+// out_width x out_height is how big it's shown, which the picture gets scaled to if it isn't its own size
+void Display_update(Display* d, Picture* pic, Denoiser* denoiser, Tonemap tonemap, int out_width, int out_height) {
+	if (pic->width == 0 || pic->height == 0) return;
+	// the raw samples, until the denoiser has something for this picture
+	if (denoiser != NULL && !Denoiser_shows(denoiser, pic)) {
+		denoiser = NULL;
+	}
+	int tiles = Picture_tileCount(pic);
+	bool everything = Display_resize(d, pic->width, pic->height, out_width, out_height) || denoiser != d->shown_denoiser || !Tonemap_equal(tonemap, d->shown_tonemap);
+	d->shown_denoiser = denoiser;
+	d->shown_tonemap = tonemap;
+
+	// the denoiser's output changes everywhere at once, and only when it reruns, not whenever a tile gets samples
+	if (denoiser != NULL) {
+		everything = everything || denoiser->runs != d->shown_runs;
+		d->shown_runs = denoiser->runs;
+		if (!everything) {
+			memset(pic->tile_dirty, false, tiles * sizeof(bool));
+			return;
+		}
+	}
+
+	int dirty = 0;
+	for (int tile = 0; tile < tiles; tile++) {
+		dirty += pic->tile_dirty[tile];
+	}
+	if (dirty == 0 && !everything) return;
+
+	d->pic = pic;
+	d->denoiser = denoiser;
+	d->tile_count = 0;
+	for (int tile = 0; tile < tiles; tile++) {
+		if (everything || pic->tile_dirty[tile]) {
+			d->tiles[d->tile_count++] = tile;
+		}
+	}
+	Jobs_parallelFor(d->tile_count, Display_convertTile, d);
+
+	if (Display_upscaling(d)) {
+		Jobs_parallelFor(d->out_height, Display_upscaleRow, d);
+		UpdateTexture(d->texture, d->upscaled);
+		d->tiles_uploaded += tiles;
+	}
+	else if (everything || dirty > tiles / 2) {
+		UpdateTexture(d->texture, d->pixels);
+		d->tiles_uploaded += tiles;
+	}
+	else {
+		for (int tile = 0; tile < tiles; tile++) {
+			if (pic->tile_dirty[tile]) {
+				Display_uploadTile(d, pic, tile);
+				d->tiles_uploaded++;
+			}
+		}
+	}
+
+	memset(pic->tile_dirty, false, tiles * sizeof(bool));
+}
+
+// x, y is the top left corner in the window, see Display_fit
+void Display_draw(Display* d, int x, int y) {
+	DrawTexture(d->texture, x, y, WHITE);
+}
+
+#endif
@@ -10,55 +10,116 @@
 #include "world.h"
 
 // HittableList type and functions
+// everything the scene is made of lives in its arenas, so building one is a handful of mallocs and getting rid of
+// it is one free per block. the objects and materials arrays double when they run out of room, and each has an
+// arena to itself so that growing one never has to copy it past the other. the lights and BVH nodes share a third
 typedef struct {
 	Hittable* objects;
 	Hittable* first_child; // first BVH node
 	int len;
+	int capacity;
 	Mat* materials;
 	int mat_len;
+	int mat_capacity;
 	bool changed;
 	Cam camera;
+	Sphere* lights; // emissive spheres, for light sampling
+	int light_len;
+	Arena object_arena;
+	Arena material_arena;
+	Arena arena; // lights and BVH nodes
 } HittableList;
 
+// empties the list for another scene, keeping the arenas' blocks so loading it again doesn't allocate
 void HittableList_clear(HittableList* list) {
-	free(list->objects);
-	free(list->materials);
-	list->materials = (Mat*)malloc(sizeof(Mat));
-	list->objects = (Hittable*)malloc(sizeof(Hittable));
-	list->len = 0;
-	list->mat_len = 0;
+	Arena_reset(&(list->object_arena));
+	Arena_reset(&(list->material_arena));
+	Arena_reset(&(list->arena));
+	list->objects = NULL;
+	list->first_child = NULL;
+	list->len = list->capacity = 0;
+	list->materials = NULL;
+	list->mat_len = list->mat_capacity = 0;
+	list->lights = NULL;
+	list->light_len = 0;
+}
+
+void HittableList_free(HittableList* list) {
+	HittableList_clear(list);
+	Arena_free(&(list->object_arena));
+	Arena_free(&(list->material_arena));
+	Arena_free(&(list->arena));
+}
+
+// bytes the arenas hold on to, for the bench
+size_t HittableList_capacity(HittableList* list) {
+	return Arena_capacity(&(list->object_arena)) + Arena_capacity(&(list->material_arena)) + Arena_capacity(&(list->arena));
+}
+
+// collects every sphere with an emissive material so the integrator can aim rays at them
+void HittableList_buildLights(HittableList* list) {
+	list->light_len = 0;
+	for (int i = 0; i < list->len; i++) {
+		if (list->objects[i].hit != Sphere_hit) continue;
+		list->light_len += Mat_isEmissive(&(list->materials[list->objects[i].object.sphere.mat_i]));
+	}
+
+	list->lights = (Sphere*)Arena_alloc(&(list->arena), sizeof(Sphere) * list->light_len);
+	int n = 0;
+	for (int i = 0; i < list->len; i++) {
+		if (list->objects[i].hit != Sphere_hit) continue;
+		Sphere s = list->objects[i].object.sphere;
+		if (Mat_isEmissive(&(list->materials[s.mat_i]))) {
+			list->lights[n++] = s;
+		}
+	}
+}
+
+// finds the light that a hit at p with material mat_i landed on, or NULL if it isn't one
+Sphere* HittableList_lightAt(HittableList* list, Vec3 p, int mat_i) {
+	for (int i = 0; i < list->light_len; i++) {
+		Sphere* s = &(list->lights[i]);
+		if (s->mat_i != mat_i) continue;
+		if (fabs(Vec3Length(Vec3Subtract(p, s->center)) - s->radius) <= 1e-3 * s->radius) return s;
+	}
+	return NULL;
 }
 
 void HittableList_buildBVH(HittableList* list) {
 	printf("building BVH...\r\n");
-	list->first_child = MakeBVHNode(list->objects, 0, list->len);
+	list->first_child = MakeBVHNode(&(list->arena), list->objects, 0, list->len);
+	HittableList_buildLights(list);
 }
 
+// only before HittableList_buildBVH, the BVH points into the objects array and this can move it
 void HittableList_add(HittableList* list, Hittable obj) {
-	list->len++;
-	list->objects = (Hittable*)realloc(list->objects, sizeof(Hittable) * list->len);
-	list->objects[list->len - 1] = obj;
+	if (list->len == list->capacity) {
+		int capacity = list->capacity > 0 ? 2 * list->capacity : 16;
+		list->objects = (Hittable*)Arena_grow(&(list->object_arena), list->objects, sizeof(Hittable) * list->capacity, sizeof(Hittable) * capacity);
+		list->capacity = capacity;
+	}
+	list->objects[list->len++] = obj;
 }
 
 int HittableList_addMat(HittableList* list, Mat mat) {
-	list->mat_len++;
-	list->materials = (Mat*)realloc(list->materials, sizeof(Mat) * list->mat_len);
-	list->materials[list->mat_len - 1] = mat;
+	if (list->mat_len == list->mat_capacity) {
+		int capacity = list->mat_capacity > 0 ? 2 * list->mat_capacity : 16;
+		list->materials = (Mat*)Arena_grow(&(list->material_arena), list->materials, sizeof(Mat) * list->mat_capacity, sizeof(Mat) * capacity);
+		list->mat_capacity = capacity;
+	}
+	list->materials[list->mat_len++] = mat;
 	return list->mat_len - 1;
 }
 
 HittableList MakeHittableList() {
-	return (HittableList){
-		 (Hittable*)malloc(sizeof(Hittable)),
-		 (Hittable*)malloc(sizeof(Hittable)),
-		 0,
-		 (Mat*)malloc(sizeof(Mat)),
-		 0,
-		 false
-	};
+	HittableList list = {0};
+	list.object_arena = MakeArena();
+	list.material_arena = MakeArena();
+	list.arena = MakeArena();
+	return list;
 }
 
-bool HittableList_hit(HittableList* l, const Ray r, double t_min, double t_max, HitRecord* rec) {
+bool HittableList_hit(HittableList* l, const Ray3 r, double t_min, double t_max, HitRecord* rec) {
 	// HitRecord temp_rec;
 	return l->first_child->hit(l->first_child->object, r, t_min, t_max, rec);
 	/*
@@ -75,6 +136,11 @@ bool HittableList_hit(HittableList* l, const Ray r, double t_min, double t_max,
 	// return hit_anything;
 }
 
+// yes/no visibility query for shadow rays; stops at the first hit and never fills in a HitRecord
+bool HittableList_occluded(HittableList* l, const Ray3 r, double t_min, double t_max) {
+	return l->first_child->occluded(l->first_child->object, r, t_min, t_max);
+}
+
 void HittableList_print(HittableList* l, char* tabulation) {
 	printf("%slist of length %d\r\n", tabulation, l->len);
 	for (int i = 0; i < l->len; i++) {
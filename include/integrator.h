@@ -0,0 +1,143 @@
+#ifndef INTEGRATOR
+#define INTEGRATOR
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include "utils.h"
+#include "world.h"
+#include "hittable_list.h"
+#include "sampler.h"
+#include "picture.h"
+
+int rr_min_bounces = 3; // bounces before russian roulette can kill a path
+
+Vec3 sky_color(Ray3 r) {
+	// return color(0,0,0); // black sky
+	Vec3 unit_direction = UnitVector(r.direction);
+	double t = 0.5 * (unit_direction.y + 1.0f);
+	return Vec3Add(Vec3Scale(Vec3One(), 1.0f - t), Vec3Scale(color(0.5, 0.7, 1.0), t));
+}
+
+// next event estimation: pick a light, aim a ray straight at it, and weight what comes back against
+// the chance that the material's own scatter would have found that light too (multiple importance sampling)
+// u holds three sample values: which light, and two for where on it
+Vec3 sample_lights(HittableList* world, Mat* mat, HitRecord* rec, Vec3 u) {
+	if (world->light_len == 0 || mat->eval == NULL) {
+		return color(0, 0, 0);
+	}
+
+	int light_i = (int)(u.x * world->light_len);
+	Sphere light = world->lights[light_i < world->light_len ? light_i : world->light_len - 1];
+
+	Vec3 direction;
+	double light_pdf;
+	if (!Sphere_sampleSolidAngle(light, rec->p, u.y, u.z, &direction, &light_pdf)) {
+		return color(0, 0, 0);
+	}
+	light_pdf /= world->light_len; // chance of having picked this light
+
+	double bsdf_pdf;
+	Vec3 f = mat->eval(mat->object, rec, direction, &bsdf_pdf);
+	if (bsdf_pdf <= 0) {
+		return color(0, 0, 0); // light is behind the surface
+	}
+
+	Ray3 shadow_ray = ray(rec->p, direction);
+	HitRecord light_rec;
+	HittableObject light_object;
+	light_object.sphere = light;
+	if (!Sphere_hit(light_object, shadow_ray, 0.001, INFINITY, &light_rec)) {
+		return color(0, 0, 0);
+	}
+	if (HittableList_occluded(world, shadow_ray, 0.001, light_rec.t - 0.001)) {
+		return color(0, 0, 0);
+	}
+
+	// emissive materials report their light through scatter()
+	Ray3 unused;
+	Vec3 emitted = color(0, 0, 0);
+	Mat* light_mat = &(world->materials[light.mat_i]);
+	light_mat->scatter(light_mat->object, shadow_ray, &light_rec, Vec3Zero(), &emitted, &unused);
+
+	return Vec3Scale(Vec3Multiply(f, emitted), power_heuristic(light_pdf, bsdf_pdf) / light_pdf);
+}
+
+// ps supplies every random number the path needs, see sampler.h for which dimension is used for what.
+// if features isn't NULL it gets filled in with what the camera ray hit first
+Vec3 ray_color(Ray3 r, HittableList* world, int max_depth, PixelSample* ps, Features* features) {
+	// iterative path tracer: instead of multiplying attenuations on the way back up the recursion
+	// we carry the product of everything hit so far (the throughput) along the path
+	Vec3 throughput = Vec3One();
+	Vec3 radiance = color(0, 0, 0);
+
+	// how the current ray was picked, for weighting lights it hits against sample_lights.
+	// camera rays and mirror/glass bounces can't be light sampled, so lights they hit count fully
+	bool specular_bounce = true;
+	double bsdf_pdf = 0;
+	Vec3 prev_p = r.position;
+
+	for (int depth = 0; depth < max_depth; depth++) {
+		// every bounce reads from a fixed block of dimensions, however many the previous ones used
+		int dim = DIM_BOUNCE + depth * DIMS_PER_BOUNCE;
+		ps->dim = dim + DIM_SCATTER;
+		Vec3 u = vec3(PixelSample_next(ps), PixelSample_next(ps), PixelSample_next(ps));
+		ps->dim = dim + DIM_LIGHT;
+		Vec3 light_u = vec3(PixelSample_next(ps), PixelSample_next(ps), PixelSample_next(ps));
+		ps->dim = dim + DIM_ROULETTE;
+		double roulette_u = PixelSample_next(ps);
+
+		HitRecord rec;
+		if (!HittableList_hit(world, r, 0.001, INFINITY, &rec)) {
+			if (depth == 0 && features != NULL) {
+				*features = (Features){sky_color(r), vec3(0, 0, 0), 0};
+			}
+			return Vec3Add(radiance, Vec3Multiply(throughput, sky_color(r)));
+		}
+
+		Ray3 scattered;
+		Vec3 attenuation = color(0, 0, 0);
+		Mat* mat = &(world->materials[rec.mat_i]);
+		bool scatters = mat->scatter(mat->object, r, &rec, u, &attenuation, &scattered);
+		if (depth == 0 && features != NULL) {
+			// lights "reflect" their own color, clamped so it still reads as an albedo
+			*features = (Features){Vec3Min(attenuation, Vec3One()), rec.normal, rec.t * Vec3Length(r.direction)};
+		}
+		if (!scatters) {
+			// absorbed, or hit a light
+			double weight = 1;
+			if (!specular_bounce && Mat_isEmissive(mat)) {
+				Sphere* light = HittableList_lightAt(world, rec.p, rec.mat_i);
+				if (light != NULL) {
+					weight = power_heuristic(bsdf_pdf, Sphere_solidAnglePdf(*light, prev_p) / world->light_len);
+				}
+			}
+			return Vec3Add(radiance, Vec3Scale(Vec3Multiply(throughput, attenuation), weight));
+		}
+
+		radiance = Vec3Add(radiance, Vec3Multiply(throughput, sample_lights(world, mat, &rec, light_u)));
+
+		specular_bounce = mat->eval == NULL;
+		if (!specular_bounce) {
+			mat->eval(mat->object, &rec, UnitVector(scattered.direction), &bsdf_pdf);
+		}
+		prev_p = rec.p;
+
+		throughput = Vec3Multiply(throughput, attenuation);
+
+		// russian roulette: paths that can't contribute much anymore are killed off randomly,
+		// and the ones that survive are boosted by the same amount so the image stays unbiased
+		if (depth >= rr_min_bounces) {
+			double survive = fmin(Vec3MaxComponent(throughput), 0.95);
+			if (roulette_u >= survive) {
+				return radiance;
+			}
+			throughput = Vec3Scale(throughput, 1.0 / survive);
+		}
+
+		r = scattered;
+	}
+
+	return radiance;
+}
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef JOBS
+#define JOBS
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "alloc.h"
+
+// tiny thread pool. Jobs_parallelFor(count, fn, arg) calls fn(arg, i) for every i in [0, count) spread over all
+// cores, and returns once all of them are done. the calling thread helps out, so it also works with 0 workers
+
+typedef struct {
+	pthread_t* threads;
+	int thread_count;
+
+	pthread_mutex_t lock;
+	pthread_cond_t work_ready;
+	pthread_cond_t work_done;
+
+	// the batch currently being worked on
+	void (*fn)(void* arg, int i);
+	void* arg;
+	int count;
+	atomic_int next;
+	int busy; // workers that haven't finished the current batch yet
+	unsigned batch; // bumped for every batch so sleeping workers know there's something new
+
+	bool quit;
+} JobPool;
+
+JobPool jobs;
+
+// grabs indices until there are none left
+void Jobs_work(void (*fn)(void* arg, int i), void* arg, int count) {
+	while (true) {
+		int i = atomic_fetch_add(&jobs.next, 1);
+		if (i >= count) return;
+		fn(arg, i);
+	}
+}
+
+void* Jobs_worker(void* unused) {
+	unsigned seen = 0;
+	pthread_mutex_lock(&jobs.lock);
+	while (true) {
+		while (!jobs.quit && jobs.batch == seen) {
+			pthread_cond_wait(&jobs.work_ready, &jobs.lock);
+		}
+		if (jobs.quit) break;
+		seen = jobs.batch;
+
+		void (*fn)(void* arg, int i) = jobs.fn;
+		void* arg = jobs.arg;
+		int count = jobs.count;
+		pthread_mutex_unlock(&jobs.lock);
+
+		Jobs_work(fn, arg, count);
+
+		pthread_mutex_lock(&jobs.lock);
+		if (--jobs.busy == 0) {
+			pthread_cond_signal(&jobs.work_done);
+		}
+	}
+	pthread_mutex_unlock(&jobs.lock);
+	return NULL;
+}
+
+int Jobs_cpuCount() {
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (int)n : 1;
+}
+
+// thread_count workers besides the main thread; pass Jobs_cpuCount() - 1 to use the whole machine
+void Jobs_init(int thread_count) {
+	jobs.thread_count = thread_count > 0 ? thread_count : 0;
+	jobs.threads = (pthread_t*)Alloc_malloc(sizeof(pthread_t) * (jobs.thread_count + 1));
+	pthread_mutex_init(&jobs.lock, NULL);
+	pthread_cond_init(&jobs.work_ready, NULL);
+	pthread_cond_init(&jobs.work_done, NULL);
+	jobs.batch = 0;
+	jobs.busy = 0;
+	jobs.quit = false;
+	atomic_init(&jobs.next, 0);
+
+	for (int i = 0; i < jobs.thread_count; i++) {
+		pthread_create(&jobs.threads[i], NULL, Jobs_worker, NULL);
+	}
+}
+
+void Jobs_parallelFor(int count, void (*fn)(void* arg, int i), void* arg) {
+	if (jobs.thread_count == 0 || count <= 1) {
+		for (int i = 0; i < count; i++) fn(arg, i);
+		return;
+	}
+
+	pthread_mutex_lock(&jobs.lock);
+	jobs.fn = fn;
+	jobs.arg = arg;
+	jobs.count = count;
+	atomic_store(&jobs.next, 0);
+	jobs.busy = jobs.thread_count;
+	jobs.batch++;
+	pthread_cond_broadcast(&jobs.work_ready);
+	pthread_mutex_unlock(&jobs.lock);
+
+	Jobs_work(fn, arg, count);
+
+	pthread_mutex_lock(&jobs.lock);
+	while (jobs.busy > 0) {
+		pthread_cond_wait(&jobs.work_done, &jobs.lock);
+	}
+	pthread_mutex_unlock(&jobs.lock);
+}
+
+void Jobs_shutdown() {
+	pthread_mutex_lock(&jobs.lock);
+	jobs.quit = true;
+	pthread_cond_broadcast(&jobs.work_ready);
+	pthread_mutex_unlock(&jobs.lock);
+
+	for (int i = 0; i < jobs.thread_count; i++) {
+		pthread_join(jobs.threads[i], NULL);
+	}
+	Alloc_free(jobs.threads);
+	jobs.threads = NULL;
+	jobs.thread_count = 0;
+}
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef PAGES
+#define PAGES
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "alloc.h"
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+// big allocations for the things that get walked all over at random, the scene's arenas (BVH nodes, objects and
+// materials) and the picture's buffers. on linux, blocks of PAGES_MAP_MIN and up get a mapping of their own (like
+// malloc would give them) which Pages_grow can resize without copying. with huge_pages on they're backed by 2MB pages where the system has them,
+// so a 4KB TLB entry per page doesn't run out on a big scene: explicit huge pages (MAP_HUGETLB, which only
+// exist if someone reserved them in /proc/sys/vm/nr_hugepages) first, then transparent ones (madvise), then
+// ordinary pages if neither works. off by default, see --huge-pages
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define PAGES_MAP_MIN (1024 * 1024)
+#define PAGES_SMALL_PAGE 4096
+
+bool huge_pages = false;
+
+typedef enum {
+	PAGES_HEAP, // aligned_alloc, for small blocks without huge_pages
+	PAGES_MAPPED, // mmap'd with ordinary pages, because huge_pages is off or the system wouldn't give it any
+	PAGES_TRANSPARENT, // mmap'd with MADV_HUGEPAGE, the kernel backs it with huge pages as it can
+	PAGES_HUGETLB, // explicit huge pages
+	PAGES_KINDS
+} PagesKind;
+
+const char* pages_names[PAGES_KINDS] = {"heap", "ordinary pages", "transparent huge pages", "explicit huge pages"};
+atomic_long pages_bytes[PAGES_KINDS]; // how much is out there of each kind, for the bench
+
+#ifdef __linux__
+// size bytes of anonymous memory aligned to a huge page, or NULL. size has to be a multiple of HUGE_PAGE_SIZE
+void* Pages_map(size_t size, PagesKind* kind) {
+#ifdef MAP_HUGETLB
+	void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (p != MAP_FAILED) {
+		*kind = PAGES_HUGETLB;
+		return p;
+	}
+#endif
+
+	// map a huge page more than needed and trim it to an aligned start, the kernel only uses huge pages for
+	// aligned 2MB ranges
+	char* raw = (char*)mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (raw == MAP_FAILED) return NULL;
+	char* start = (char*)(((size_t)raw + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE);
+	if (start > raw) munmap(raw, start - raw);
+	munmap(start + size, raw + HUGE_PAGE_SIZE - start);
+
+	*kind = PAGES_MAPPED;
+#ifdef MADV_HUGEPAGE
+	if (madvise(start, size, MADV_HUGEPAGE) == 0) *kind = PAGES_TRANSPARENT;
+#endif
+	return start;
+}
+#endif
+
+// *size bytes, at least cache line aligned. only mapped memory (any kind but PAGES_HEAP) comes zeroed, so a caller
+// that needs zeros clears heap blocks itself. with huge_pages on, *size gets rounded up to whole huge pages, so the
+// caller might as well use the rest. give it back with Pages_free with the same size and kind
+void* Pages_alloc(size_t* size, PagesKind* kind) {
+#ifdef __linux__
+	if (huge_pages) {
+		size_t rounded = (*size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+		void* p = Pages_map(rounded, kind);
+		if (p != NULL) {
+			atomic_fetch_add_explicit(&alloc_count, 1, memory_order_relaxed);
+			atomic_fetch_add(&pages_bytes[*kind], rounded);
+			*size = rounded;
+			return p;
+		}
+	}
+	else if (*size >= PAGES_MAP_MIN) {
+		size_t rounded = (*size + PAGES_SMALL_PAGE - 1) / PAGES_SMALL_PAGE * PAGES_SMALL_PAGE;
+		void* p = mmap(NULL, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p != MAP_FAILED) {
+			atomic_fetch_add_explicit(&alloc_count, 1, memory_order_relaxed);
+			atomic_fetch_add(&pages_bytes[PAGES_MAPPED], rounded);
+			*kind = PAGES_MAPPED;
+			*size = rounded;
+			return p;
+		}
+	}
+#endif
+
+	*size = (*size + 63) / 64 * 64;
+	void* p = Alloc_aligned(64, *size);
+	if (p == NULL) return NULL;
+	*kind = PAGES_HEAP;
+	atomic_fetch_add(&pages_bytes[PAGES_HEAP], *size);
+	return p;
+}
+
+// tries to make p (size bytes from Pages_alloc) *size bytes big without copying what's in it, for an array that
+// keeps growing. ordinary mapped pages get resized by the kernel, which moves them somewhere else if there's no room
+// after them, like realloc does for big blocks. transparent huge pages only grow where they are, so they stay
+// aligned to huge pages. returns where the block is now with *size rounded up, or NULL if it couldn't and p is
+// untouched. needs mremap, which main.c asks for with _GNU_SOURCE
+void* Pages_grow(void* p, size_t size, size_t* new_size, PagesKind kind) {
+#if defined(__linux__) && defined(MREMAP_MAYMOVE)
+	if (kind == PAGES_MAPPED || kind == PAGES_TRANSPARENT) {
+		size_t page = kind == PAGES_MAPPED ? PAGES_SMALL_PAGE : HUGE_PAGE_SIZE;
+		size_t rounded = (*new_size + page - 1) / page * page;
+		void* q = mremap(p, size, rounded, kind == PAGES_MAPPED ? MREMAP_MAYMOVE : 0);
+		if (q == MAP_FAILED) return NULL;
+		// counted as the old mapping going and a new one coming, like Alloc_realloc would be plus the free
+		atomic_fetch_add_explicit(&alloc_count, 1, memory_order_relaxed);
+		atomic_fetch_add_explicit(&free_count, 1, memory_order_relaxed);
+		atomic_fetch_add(&pages_bytes[kind], rounded - size);
+		*new_size = rounded;
+		return q;
+	}
+#endif
+	return NULL;
+}
+
+void Pages_free(void* p, size_t size, PagesKind kind) {
+	if (p == NULL) return;
+	atomic_fetch_sub(&pages_bytes[kind], size);
+#ifdef __linux__
+	if (kind != PAGES_HEAP) {
+		atomic_fetch_add_explicit(&free_count, 1, memory_order_relaxed);
+		munmap(p, size);
+		return;
+	}
+#endif
+	Alloc_free(p);
+}
+
+#endif
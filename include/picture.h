@@ -0,0 +1,461 @@
+#ifndef PICTURE
+#define PICTURE
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include "utils.h"
+#include "alloc.h"
+#include "pages.h"
+#include "camera.h"
+
+#define TILE_SIZE 16
+
+// what a pixel's camera ray hit first, for the denoiser. sky has a zero normal and zero depth
+typedef struct {
+	Vec3 albedo;
+	Vec3 normal;
+	float depth;
+} Features;
+
+// accumulation buffer. every pixel keeps its own sample count and enough to estimate its variance,
+// so converged parts of the image can stop getting samples (see Picture_updateTile).
+// after a camera move the new picture starts out with whatever of the old one is still visible (see
+// Picture_reprojectPixel), which counts as extra samples in every sum.
+//
+// every per-pixel buffer is one contiguous block in tile order: TILE_SIZE x TILE_SIZE tiles left to right, top
+// to bottom, each of them row-major inside. a tile is 4KB of color, so tracing, converging and displaying a tile
+// all stay in cache. the picture is padded to whole tiles. the buffers are all carved out of one allocation,
+// which is on huge pages with huge_pages on (see pages.h)
+typedef struct {
+	int width;
+	int height;
+	int sample_count; // passes done so far; pixels in converged tiles have fewer samples than this
+	uint32_t first_index; // sampler index of the first sample, so a picture replacing another can continue its sequence
+	Cam camera; // what the picture is seen through, so the next one can reproject it
+	Vec3* color; // running sum, with the number of samples it's worth (history included) in the w lane
+	int* samples; // per pixel sample count, not counting history
+	float* lum_sq; // per pixel sum of squared luminance
+	int tiles_x, tiles_y;
+	int tile_capacity; // how many tiles the buffers have room for, see Picture_reset
+	bool* tile_done; // converged, or got samples_per_pixel
+	int* tile_samples; // passes each tile got, which varies with foveated sampling (see render_focus)
+	int tiles_left;
+	bool* tile_dirty; // got new samples since the display last looked at it
+	long long samples_traced; // total samples over all pixels, counted by render.h since tiles get traced in parallel
+	// first hit feature sums. albedo is averaged the same way as color, history included, but normal and depth
+	// only sum the picture's own samples: they're what the denoiser stops at edges with, and resampling them from
+	// picture to picture would blur the edges away
+	Vec3* albedo;
+	Vec3* normal;
+	float* depth;
+	// where the ray through the pixel center (and lens center) hits first, traced once per picture. unlike the
+	// features above it doesn't change from sample to sample, so it can tell whether two pictures see the same
+	// surface at a pixel. sky is a point far away with a zero normal
+	Vec3* hit_position;
+	Vec3* hit_normal;
+	bool hits_traced;
+	void* buffer; // where all of the per-pixel buffers above are
+	size_t buffer_size;
+	PagesKind buffer_kind;
+	// while > 0 the first pass is traced coarse to fine: each render_pass only traces the pixels on a grid this
+	// far apart, then halves it. pixels that haven't been traced yet show the traced pixel above and left of them
+	int preview_step;
+	// which pixel of each grid cell the preview starts on (see Picture_previewOffset). pictures replacing each other
+	// while the camera moves count it up, so every frame traces a different 1/16 of the pixels instead of the
+	// same ones, and the reprojected history fills in the rest
+	int preview_phase;
+	int next_tile; // how far the pass in progress got, 0 between passes. a frame can end in the middle of a pass
+	unsigned generation; // which render_restart made it, so whoever keeps something made from it can tell it's been replaced
+} Picture;
+
+// the next size bytes of the picture's buffer, which stay cache line aligned as long as size is a multiple of 64.
+// anything per-pixel is, with 16x16 tiles
+void* Picture_carve(char** at, size_t size) {
+	void* buffer = *at;
+	*at += size;
+	return buffer;
+}
+
+Picture MakePicture(int width, int height) {
+	Picture p = {
+		width,
+		height,
+		0
+	};
+
+	p.tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+	p.tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+	p.tile_capacity = p.tiles_x * p.tiles_y;
+	size_t n = (size_t)p.tiles_x * p.tiles_y * TILE_SIZE * TILE_SIZE;
+
+	// zeroed, like everything needs to start out. mapped pages already are
+	p.buffer_size = n * (5 * sizeof(Vec3) + sizeof(int) + 2 * sizeof(float));
+	p.buffer = Pages_alloc(&p.buffer_size, &p.buffer_kind);
+	if (p.buffer != NULL && p.buffer_kind == PAGES_HEAP) memset(p.buffer, 0, p.buffer_size);
+	char* at = (char*)p.buffer;
+
+	p.color = (Vec3*)Picture_carve(&at, n * sizeof(Vec3));
+	p.samples = (int*)Picture_carve(&at, n * sizeof(int));
+	p.lum_sq = (float*)Picture_carve(&at, n * sizeof(float));
+
+	p.tile_done = (bool*)Alloc_calloc(p.tiles_x * p.tiles_y, sizeof(bool));
+	p.tile_samples = (int*)Alloc_calloc(p.tiles_x * p.tiles_y, sizeof(int));
+	p.tiles_left = p.tiles_x * p.tiles_y;
+	p.tile_dirty = (bool*)Alloc_malloc(p.tiles_x * p.tiles_y * sizeof(bool));
+	memset(p.tile_dirty, true, p.tiles_x * p.tiles_y * sizeof(bool));
+	p.samples_traced = 0;
+
+	p.albedo = (Vec3*)Picture_carve(&at, n * sizeof(Vec3));
+	p.normal = (Vec3*)Picture_carve(&at, n * sizeof(Vec3));
+	p.depth = (float*)Picture_carve(&at, n * sizeof(float));
+	p.hit_position = (Vec3*)Picture_carve(&at, n * sizeof(Vec3));
+	p.hit_normal = (Vec3*)Picture_carve(&at, n * sizeof(Vec3));
+	p.hits_traced = false;
+
+	return p;
+}
+
+int Picture_index(Picture *p, int u, int v) {
+	int tile = (v / TILE_SIZE) * p->tiles_x + u / TILE_SIZE;
+	return tile * TILE_SIZE * TILE_SIZE + (v % TILE_SIZE) * TILE_SIZE + u % TILE_SIZE;
+}
+
+int Picture_tileCount(Picture *p) {
+	return p->tiles_x * p->tiles_y;
+}
+
+// the tile's pixels are [x0, x1) x [y0, y1), clipped to the picture
+void Picture_tileBounds(Picture *p, int tile, int* x0, int* y0, int* x1, int* y1) {
+	*x0 = (tile % p->tiles_x) * TILE_SIZE;
+	*y0 = (tile / p->tiles_x) * TILE_SIZE;
+	*x1 = *x0 + TILE_SIZE < p->width ? *x0 + TILE_SIZE : p->width;
+	*y1 = *y0 + TILE_SIZE < p->height ? *y0 + TILE_SIZE : p->height;
+}
+
+// the tile's TILE_SIZE * TILE_SIZE sums, row-major. pixel (u, v) of the tile is at [(v - y0) * TILE_SIZE + u - x0]
+Vec3* Picture_tile(Picture *p, int tile) {
+	return p->color + (size_t)tile * TILE_SIZE * TILE_SIZE;
+}
+
+// how far apart the pixels traced so far in a coarse first pass are, 1 when there's no preview going on
+int Picture_previewStride(Picture *p) {
+	return p->preview_step > 0 ? p->preview_step * 2 : 1;
+}
+
+// where the preview's grid starts in each 4x4 cell. the low bits of the phase pick the position in the 2x2
+// block and the high bits the 2x2 block, both in the order (0,0) (1,1) (1,0) (0,1), so consecutive phases are
+// diagonal from each other and every 4 of them cover a 2x2 block, like the ordered dither in a bayer matrix
+void Picture_previewOffset(Picture *p, int* x, int* y) {
+	static const int order_x[4] = {0, 1, 1, 0};
+	static const int order_y[4] = {0, 1, 0, 1};
+	int fine = p->preview_phase & 3;
+	int coarse = (p->preview_phase >> 2) & 3;
+	*x = order_x[fine] + 2 * order_x[coarse];
+	*y = order_y[fine] + 2 * order_y[coarse];
+}
+
+// moves (u, v) to the pixel whose sum stands in for it during a preview: itself if it has anything, otherwise
+// the nearest traced one above and left of it (right or below at the picture's edge)
+void Picture_previewSource(Picture *p, int* u, int* v) {
+	int stride = Picture_previewStride(p);
+	if (stride == 1 || p->color[Picture_index(p, *u, *v)].w > 0) return;
+
+	int ox, oy;
+	Picture_previewOffset(p, &ox, &oy);
+	// stride is a power of 2, so & wraps negative differences the right way
+	*u -= (*u - ox) & (stride - 1);
+	*v -= (*v - oy) & (stride - 1);
+	if (*u < 0) *u += stride;
+	if (*v < 0) *v += stride;
+	if (*u >= p->width) *u = p->width - 1;
+	if (*v >= p->height) *v = p->height - 1;
+}
+
+// sum of all samples so far
+Vec3 Picture_at(Picture *p, int u, int v) {
+	Vec3 sum = p->color[Picture_index(p, u, v)];
+	sum.w = 0;
+	return sum;
+}
+
+// how many samples the sums are worth, history included
+float Picture_weight(Picture *p, int u, int v) {
+	return p->color[Picture_index(p, u, v)].w;
+}
+
+// how many of those came from the previous picture
+float Picture_history(Picture *p, int u, int v) {
+	int i = Picture_index(p, u, v);
+	return p->color[i].w - p->samples[i];
+}
+
+// mean of a sum with its weight in the w lane
+Vec3 Picture_resolve(Vec3 sum) {
+	Vec3 mean = sum.w > 0 ? Vec3Scale(sum, 1.0f / sum.w) : color(0, 0, 0);
+	mean.w = 0;
+	return mean;
+}
+
+Vec3 Picture_mean(Picture *p, int u, int v) {
+	return Picture_resolve(p->color[Picture_index(p, u, v)]);
+}
+
+void Picture_addSample(Picture *p, int u, int v, Vec3 color) {
+	int i = Picture_index(p, u, v);
+	double l = luminance(color);
+	float weight = p->color[i].w + 1;
+	p->color[i] = Vec3Add(p->color[i], color);
+	p->color[i].w = weight;
+	p->lum_sq[i] += l * l;
+	p->samples[i]++;
+}
+
+void Picture_addFeatures(Picture *p, int u, int v, Features f) {
+	int i = Picture_index(p, u, v);
+	p->albedo[i] = Vec3Add(p->albedo[i], f.albedo);
+	p->normal[i] = Vec3Add(p->normal[i], f.normal);
+	p->depth[i] += f.depth;
+}
+
+void Picture_setHit(Picture *p, int u, int v, Vec3 position, Vec3 normal) {
+	int i = Picture_index(p, u, v);
+	p->hit_position[i] = position;
+	p->hit_normal[i] = normal;
+}
+
+// averaged features; call after Picture_addSample so the sample count matches. a pixel that only has history
+// gets the normal and depth of its center ray instead
+Features Picture_features(Picture *p, int u, int v) {
+	int i = Picture_index(p, u, v);
+	float n = Picture_weight(p, u, v);
+	if (n == 0) return (Features){color(0, 0, 0), vec3(0, 0, 0), 0};
+	Vec3 albedo = Vec3Scale(p->albedo[i], 1.0 / n);
+
+	if (p->samples[i] == 0) {
+		if (!p->hits_traced) return (Features){albedo, vec3(0, 0, 0), 0};
+		Vec3 normal = p->hit_normal[i];
+		return (Features){albedo, normal, Vec3NearZero(normal) ? 0 : Vec3Length(Vec3Subtract(p->hit_position[i], p->camera.origin))};
+	}
+
+	Vec3 normal = p->normal[i];
+	float len = Vec3Length(normal);
+	return (Features){
+		albedo,
+		len > 1e-6 ? Vec3Scale(normal, 1.0 / len) : vec3(0, 0, 0),
+		p->depth[i] / p->samples[i]
+	};
+}
+
+// variance of the pixel's mean luminance
+double Picture_variance(Picture *p, int u, int v) {
+	int i = Picture_index(p, u, v);
+	float n = Picture_weight(p, u, v);
+	if (n < 2) return INFINITY;
+
+	double mean = luminance(p->color[i]) / n;
+	return fmax(0.0, (p->lum_sq[i] / n - mean * mean) / (n - 1));
+}
+
+// standard error of the pixel's mean, measured after gamma (so it's roughly what you'd see on screen)
+double Picture_pixelError(Picture *p, int u, int v) {
+	float n = Picture_weight(p, u, v);
+	if (n < 2) return INFINITY;
+
+	double mean = luminance(p->color[Picture_index(p, u, v)]) / n;
+	double std_error = sqrt(Picture_variance(p, u, v));
+
+	if (mean - 3 * std_error > 1.0) return 0; // clipped to white on screen anyway
+	// d(sqrt(x))/dx, floored so black pixels don't blow up
+	return std_error / (2 * sqrt(fmax(mean, 1e-3)));
+}
+
+// whether pixel q of old sees the same surface as a pixel of p whose center ray hit `position` with `normal`.
+// a mismatch is a disocclusion: something else is in front now, or it's a different side of the object
+bool Picture_historyMatches(Picture *old, int q, Vec3 position, Vec3 normal) {
+	bool sky = Vec3NearZero(normal);
+	if (sky != Vec3NearZero(old->hit_normal[q])) return false;
+	if (sky) return true;
+
+	float expected_depth = Vec3Length(Vec3Subtract(position, old->camera.origin));
+	float depth = Vec3Length(Vec3Subtract(old->hit_position[q], old->camera.origin));
+	return fabsf(depth - expected_depth) <= 0.1f * expected_depth && Vec3DotProduct(normal, old->hit_normal[q]) >= 0.9f;
+}
+
+// adds `weight` of old's pixel q, normalized to one sample, to the running sums. false if q has no samples to give,
+// which happens in a picture that was only traced partway
+bool Picture_gatherHistory(Picture *old, int q, float weight, Vec3* col, Vec3* albedo, float* lum_sq, float* history) {
+	Vec3 sum = old->color[q];
+	float n = sum.w;
+	if (n == 0) return false;
+	sum.w = 0;
+
+	float w = weight / n;
+	*col = Vec3Add(*col, Vec3Scale(sum, w));
+	*albedo = Vec3Add(*albedo, Vec3Scale(old->albedo[q], w));
+	*lum_sq += old->lum_sq[q] * w;
+	*history += n * weight;
+	return true;
+}
+
+// seeds pixel (u, v) of p, which has no samples yet, with what old saw of the same surface: follows the motion
+// vector from the pixel's first hit back into old's view and blends the 4 old pixels around it that still see
+// that surface. if none of them do, it falls back to whatever matches in the 3x3 around it like SVGF does,
+// which saves thin features and edges. the history is worth at most max_history samples, so errors from
+// resampling over and over can't build up forever. both pictures need their hit_position and hit_normal
+void Picture_reprojectPixel(Picture *p, Picture *old, int u, int v, float max_history) {
+	int i = Picture_index(p, u, v);
+	Vec3 position = p->hit_position[i];
+	Vec3 normal = p->hit_normal[i];
+
+	double s, t;
+	if (!Camera_project(old->camera, position, &s, &t)) return;
+
+	// to old's pixel grid, pixel centers at integers
+	float fu = s * (old->width - 1) - 0.5f;
+	float fv = t * (old->height - 1) - 0.5f;
+	int u0 = (int)floorf(fu);
+	int v0 = (int)floorf(fv);
+	float tu = fu - u0;
+	float tv = fv - v0;
+
+	Vec3 col = color(0, 0, 0), albedo = color(0, 0, 0);
+	float lum_sq = 0, history = 0, weight_sum = 0;
+	for (int k = 0; k < 4; k++) {
+		int uu = u0 + (k & 1);
+		int vv = v0 + (k >> 1);
+		if (uu < 0 || uu >= old->width || vv < 0 || vv >= old->height) continue;
+
+		int q = Picture_index(old, uu, vv);
+		if (!Picture_historyMatches(old, q, position, normal)) continue;
+
+		float weight = ((k & 1) ? tu : 1 - tu) * ((k >> 1) ? tv : 1 - tv);
+		if (Picture_gatherHistory(old, q, weight, &col, &albedo, &lum_sq, &history)) {
+			weight_sum += weight;
+		}
+	}
+
+	if (weight_sum <= 1e-3f) {
+		col = albedo = color(0, 0, 0);
+		lum_sq = history = weight_sum = 0;
+
+		int cu = (int)floorf(fu + 0.5f);
+		int cv = (int)floorf(fv + 0.5f);
+		for (int vv = cv - 1; vv <= cv + 1; vv++) {
+			if (vv < 0 || vv >= old->height) continue;
+			for (int uu = cu - 1; uu <= cu + 1; uu++) {
+				if (uu < 0 || uu >= old->width) continue;
+
+				int q = Picture_index(old, uu, vv);
+				if (!Picture_historyMatches(old, q, position, normal)) continue;
+
+				if (Picture_gatherHistory(old, q, 1, &col, &albedo, &lum_sq, &history)) {
+					weight_sum++;
+				}
+			}
+		}
+	}
+
+	if (weight_sum <= 1e-3f || history <= 0) return;
+
+	// the gathered sums are per sample, scale them back up to n samples worth
+	float n = fminf(history / weight_sum, max_history);
+	float scale = n / weight_sum;
+	p->color[i] = Vec3Scale(col, scale);
+	p->color[i].w = n;
+	p->albedo[i] = Vec3Scale(albedo, scale);
+	p->lum_sq[i] = lum_sq * scale;
+}
+
+// drops whatever Picture_reprojectPixel put in a fresh picture, for a reprojection that didn't finish
+void Picture_clearHistory(Picture *p) {
+	size_t n = (size_t)p->tiles_x * p->tiles_y * TILE_SIZE * TILE_SIZE;
+	memset(p->color, 0, n * sizeof(Vec3));
+	memset(p->albedo, 0, n * sizeof(Vec3));
+	memset(p->lum_sq, 0, n * sizeof(float));
+}
+
+int Picture_tileOf(Picture *p, int u, int v) {
+	return (v / TILE_SIZE) * p->tiles_x + u / TILE_SIZE;
+}
+
+bool Picture_tileDone(Picture *p, int tile) {
+	return p->tile_done[tile];
+}
+
+// marks the tile as done once every pixel in it has at least min_samples and an error below target, and returns
+// true if it just got there. tiles get updated from several threads, so the caller counts it off tiles_left
+bool Picture_updateTile(Picture *p, int tile, double target, int min_samples) {
+	if (p->tile_done[tile]) return false;
+
+	int x0, y0, x1, y1;
+	Picture_tileBounds(p, tile, &x0, &y0, &x1, &y1);
+	for (int v = y0; v < y1; v++) {
+		for (int u = x0; u < x1; u++) {
+			if (p->samples[Picture_index(p, u, v)] < min_samples) return false;
+			if (Picture_pixelError(p, u, v) > target) return false;
+		}
+	}
+
+	p->tile_done[tile] = true;
+	return true;
+}
+
+void Picture_free(Picture *p) {
+	Pages_free(p->buffer, p->buffer_size, p->buffer_kind);
+	Alloc_free(p->tile_done);
+	Alloc_free(p->tile_samples);
+	Alloc_free(p->tile_dirty);
+	*p = (Picture){0};
+}
+
+// turns p into what MakePicture(width, height) would give, in the buffers it already has if they're big enough.
+// pictures get replaced on every camera move, and are never bigger than the full size, so after the first few
+// that doesn't allocate anything
+void Picture_reset(Picture *p, int width, int height) {
+	int tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+	int tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+	int tiles = tiles_x * tiles_y;
+	if (tiles > p->tile_capacity || p->color == NULL) {
+		Picture_free(p);
+		*p = MakePicture(width, height);
+		return;
+	}
+
+	Picture old = *p;
+	*p = (Picture){width, height, 0};
+	p->tiles_x = tiles_x;
+	p->tiles_y = tiles_y;
+	p->tile_capacity = old.tile_capacity;
+	p->tiles_left = tiles;
+
+	size_t n = (size_t)tiles * TILE_SIZE * TILE_SIZE;
+	p->color = old.color;
+	p->samples = old.samples;
+	p->lum_sq = old.lum_sq;
+	p->albedo = old.albedo;
+	p->normal = old.normal;
+	p->depth = old.depth;
+	p->hit_position = old.hit_position;
+	p->hit_normal = old.hit_normal;
+	p->buffer = old.buffer;
+	p->buffer_size = old.buffer_size;
+	p->buffer_kind = old.buffer_kind;
+	memset(p->color, 0, n * sizeof(Vec3));
+	memset(p->samples, 0, n * sizeof(int));
+	memset(p->lum_sq, 0, n * sizeof(float));
+	memset(p->albedo, 0, n * sizeof(Vec3));
+	memset(p->normal, 0, n * sizeof(Vec3));
+	memset(p->depth, 0, n * sizeof(float));
+	memset(p->hit_position, 0, n * sizeof(Vec3));
+	memset(p->hit_normal, 0, n * sizeof(Vec3));
+
+	p->tile_done = old.tile_done;
+	p->tile_samples = old.tile_samples;
+	p->tile_dirty = old.tile_dirty;
+	memset(p->tile_done, false, tiles * sizeof(bool));
+	memset(p->tile_samples, 0, tiles * sizeof(int));
+	memset(p->tile_dirty, true, tiles * sizeof(bool));
+}
+
+#endif
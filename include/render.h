@@ -0,0 +1,386 @@
+#ifndef RENDER
+#define RENDER
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <stdatomic.h>
+#include "utils.h"
+#include "hittable_list.h"
+#include "camera.h"
+#include "picture.h"
+#include "sampler.h"
+#include "integrator.h"
+#include "jobs.h"
+
+int samples_per_pixel = 1000;
+int max_bounces = 25;
+
+// adaptive sampling: a tile stops getting samples once every pixel in it has at least adaptive_min_samples
+// and an estimated on-screen error under adaptive_threshold (1.0 being the full brightness range)
+double adaptive_threshold = 0.01;
+int adaptive_min_samples = 16;
+
+// after a change the first pass is traced on every preview_stride-th pixel first (a 1/16 preview), then every
+// 2nd, then the rest, one step per frame. the coarse samples stay in the picture, so nothing gets traced twice.
+// at most 4, that's as far as Picture_previewOffset's pattern goes
+int preview_stride = 4;
+
+// how many samples a pixel's reprojected history can be worth after a camera move
+float reprojection_max_history = 16;
+
+// generation of the work in flight. render_cancel bumps it when the picture being rendered is about to be thrown
+// away (the camera moved), from any thread. batches remember the generation they started in and check it before
+// every path, so they stop within a path of it, and a path that was already going gets dropped instead of added
+atomic_uint render_epoch;
+
+void render_cancel() {
+	atomic_fetch_add(&render_epoch, 1);
+}
+
+static inline unsigned render_generation() {
+	return atomic_load_explicit(&render_epoch, memory_order_relaxed);
+}
+
+static inline bool render_stale(unsigned epoch) {
+	return render_generation() != epoch;
+}
+
+// the work that waits on the render thread besides the picture. interactive is the ui thread wanting the picture
+// (see Renderer_lock) and comes before its tiles: a batch stops taking new ones as soon as it's waiting, so that
+// never waits for more than the tiles already being traced. background is whatever can wait until the render is
+// done (Renderer_background). the preview and the refinement passes are the same picture, one after the other, so
+// there's nothing to rank between them
+typedef enum {
+	RENDER_INTERACTIVE,
+	RENDER_BACKGROUND,
+	RENDER_PRIORITIES
+} RenderPriority;
+
+// how much work of each class is waiting for the render thread
+atomic_int render_waiting[RENDER_PRIORITIES];
+
+// whether the picture's tiles should step aside
+static inline bool render_preempted() {
+	return atomic_load_explicit(&render_waiting[RENDER_INTERACTIVE], memory_order_relaxed) > 0;
+}
+
+// fills in the picture's hit_position and hit_normal for pixel (i, j)
+void trace_primary(HittableList* world, Picture* pic, int i, int j) {
+	Ray3 r = Camera_getRay(world->camera, (i + 0.5) / (pic->width - 1), (j + 0.5) / (pic->height - 1), 0.5, 0.5);
+
+	HitRecord rec;
+	if (HittableList_hit(world, r, 0.001, INFINITY, &rec)) {
+		Picture_setHit(pic, i, j, rec.p, rec.normal);
+	}
+	else {
+		Picture_setHit(pic, i, j, Ray_at(r, 1e5 / Vec3Length(r.direction)), vec3(0, 0, 0));
+	}
+}
+
+// state for the row jobs below
+typedef struct {
+	HittableList* world;
+	Picture* pic;
+	Picture* old;
+	unsigned epoch;
+} RenderRows;
+
+void render_hitsRow(void* arg, int j) {
+	RenderRows* r = (RenderRows*)arg;
+	if (render_stale(r->epoch)) return;
+	for (int i = 0; i < r->pic->width; i++) {
+		trace_primary(r->world, r->pic, i, j);
+	}
+}
+
+// traces the picture's center rays if that hasn't happened yet, and remembers the camera they were traced with
+void render_hits(HittableList* world, Picture* pic) {
+	if (pic->hits_traced) return;
+	pic->camera = world->camera;
+	RenderRows r = {world, pic, NULL, render_generation()};
+	Jobs_parallelFor(pic->height, render_hitsRow, &r);
+	pic->hits_traced = !render_stale(r.epoch);
+}
+
+void render_reprojectRow(void* arg, int j) {
+	RenderRows* r = (RenderRows*)arg;
+	if (render_stale(r->epoch)) return;
+	for (int i = 0; i < r->pic->width; i++) {
+		Picture_reprojectPixel(r->pic, r->old, i, j, reprojection_max_history);
+	}
+}
+
+// starts a fresh picture off with everything of old that's still visible from the current camera. a cancel stops
+// it within a row, and leaves the picture without any history rather than with some of it: untraced hits read
+// as sky, which would pick up the wrong pixels
+void render_reproject(HittableList* world, Picture* pic, Picture* old) {
+	if (!old->hits_traced) return;
+	unsigned epoch = render_generation(); // before the hits, so a cancel while they're traced counts too
+	render_hits(world, pic);
+	if (!pic->hits_traced || render_stale(epoch)) return;
+	RenderRows r = {world, pic, old, epoch};
+	Jobs_parallelFor(pic->height, render_reprojectRow, &r);
+	if (render_stale(epoch)) {
+		Picture_clearHistory(pic);
+	}
+}
+
+// how many pictures render_restart has made, for Picture.generation
+unsigned render_restarts;
+
+// replaces pic with a fresh width x height one for the current camera, in spare's buffers, and the old one becomes
+// the spare, so camera moves and size changes don't allocate once both have been full size. the old picture's
+// samples that are still visible carry over, and the sample sequence goes on where it left off so the history and
+// the new samples don't repeat the same pattern
+void render_restart(HittableList* world, Picture* pic, Picture* spare, int width, int height) {
+	Picture old = *pic;
+	*pic = *spare;
+	*spare = old;
+	Picture_reset(pic, width, height);
+	pic->first_index = old.first_index + old.sample_count;
+	pic->preview_step = preview_stride;
+	pic->preview_phase = old.preview_phase + 1;
+	pic->generation = ++render_restarts;
+	render_reproject(world, pic, spare);
+}
+
+// false if the work got cancelled while the path was being traced, in which case the picture doesn't see it
+bool trace_pixel(HittableList* world, Picture* pic, Sampler* sampler, int i, int j, unsigned epoch) {
+	PixelSample ps = {sampler, i, j, pic->first_index + pic->samples[Picture_index(pic, i, j)], DIM_PIXEL};
+	double u = (i + PixelSample_next(&ps)) / (pic->width - 1);
+	double v = (j + PixelSample_next(&ps)) / (pic->height - 1);
+
+	ps.dim = DIM_LENS;
+	double lens_u = PixelSample_next(&ps);
+	double lens_v = PixelSample_next(&ps);
+	Ray3 r = Camera_getRay(world->camera, u, v, lens_u, lens_v);
+
+	Features features;
+	Vec3 c = ray_color(r, world, max_bounces, &ps, &features);
+	if (render_stale(epoch)) return false;
+	Picture_addSample(pic, i, j, c);
+	Picture_addFeatures(pic, i, j, features);
+	return true;
+}
+
+// every tile has converged or has samples_per_pixel
+bool render_done(Picture* pic) {
+	return pic->tiles_left == 0;
+}
+
+// fraction of samples_per_pixel * pixels that adaptive sampling didn't have to trace
+double render_savings(Picture* pic) {
+	// with foveation on there can be more passes than samples_per_pixel, the focus got its samples first
+	int passes = pic->sample_count < samples_per_pixel ? pic->sample_count : samples_per_pixel;
+	double full = (double)pic->width * pic->height * passes;
+	return full > 0 ? 1.0 - pic->samples_traced / full : 0;
+}
+
+// foveated sampling: while active, tiles around the focus (the mouse cursor with a radius, or a rectangle dragged
+// with it) get a sample every pass, and tiles further away get one every few passes, half as often every
+// `falloff` pixels out, down to min_rate. the focus gets to samples_per_pixel first and the rest catches up after
+typedef struct {
+	bool active;
+	float x0, y0, x1, y1; // picture pixels, v up like the picture. x0 == x1 and y0 == y1 for the cursor
+	float radius;
+	float falloff;
+	float min_rate;
+} Focus;
+
+Focus render_focus = {false, 0, 0, 0, 0, 64, 64, 1.0f / 16};
+
+// how many samples per pass the tile should get
+float render_tileRate(Picture* pic, int tile) {
+	if (!render_focus.active) return 1;
+
+	// from the focus to the nearest pixel of the tile, so a tile the focus only just touches is in it
+	int x0, y0, x1, y1;
+	Picture_tileBounds(pic, tile, &x0, &y0, &x1, &y1);
+	float dx = fmaxf(0.0f, fmaxf(render_focus.x0 - (x1 - 1), x0 - render_focus.x1));
+	float dy = fmaxf(0.0f, fmaxf(render_focus.y0 - (y1 - 1), y0 - render_focus.y1));
+	float distance = sqrtf(dx * dx + dy * dy) - render_focus.radius;
+	if (distance <= 0) return 1;
+	return render_focus.min_rate > 0 ? fmaxf(render_focus.min_rate, exp2f(-distance / render_focus.falloff)) : 0;
+}
+
+// whether the tile gets traced in the pass in progress. a tile with rate r is in floor(r * passes) of them, spread
+// out evenly. previews always cover everything, they're about getting something on screen
+bool render_tileWanted(Picture* pic, int tile) {
+	if (Picture_tileDone(pic, tile)) return false;
+	if (pic->preview_step > 0) return true;
+	float rate = render_tileRate(pic, tile);
+	int pass = pic->sample_count;
+	return floorf((pass + 1) * rate) > floorf(pass * rate);
+}
+
+// traces one tile's share of the pass in progress: a sample for every pixel, or during a preview the pixels on the
+// current step's grid that a coarser step didn't get. returns how many samples that was and sets *finished if the
+// tile doesn't need any more (adaptive sampling says it converged, or it has samples_per_pixel). only touches the
+// tile's own pixels, so tiles can go in parallel. stops as soon as epoch is stale, without counting the tile's pass
+int render_tile(HittableList* world, Picture* pic, Sampler* sampler, int tile, unsigned epoch, bool* finished) {
+	*finished = false;
+	if (!render_tileWanted(pic, tile)) return 0;
+	pic->tile_dirty[tile] = true;
+
+	int x0, y0, x1, y1;
+	Picture_tileBounds(pic, tile, &x0, &y0, &x1, &y1);
+	int step = pic->preview_step;
+	int traced = 0;
+	if (step > 0) {
+		// tiles start on multiples of 16, so the grid lines up with them
+		int ox, oy;
+		Picture_previewOffset(pic, &ox, &oy);
+		for (int j = y0 + oy % step; j < y1; j += step) {
+			for (int i = x0 + ox % step; i < x1; i += step) {
+				if (pic->samples[Picture_index(pic, i, j)] == 0) {
+					if (!trace_pixel(world, pic, sampler, i, j, epoch)) return traced;
+					traced++;
+				}
+			}
+		}
+		// only the last step completes the tile's first sample
+		if (step > 1) return traced;
+	}
+	else {
+		for (int j = y0; j < y1; j++) {
+			for (int i = x0; i < x1; i++) {
+				if (!trace_pixel(world, pic, sampler, i, j, epoch)) return traced;
+				traced++;
+			}
+		}
+	}
+
+	pic->tile_samples[tile]++;
+	if (pic->tile_samples[tile] >= samples_per_pixel) {
+		pic->tile_done[tile] = true;
+		*finished = true;
+	}
+	else if (pic->tile_samples[tile] >= adaptive_min_samples) {
+		*finished = Picture_updateTile(pic, tile, adaptive_threshold, adaptive_min_samples);
+	}
+	return traced;
+}
+
+// state for render_tileJob: up to count tiles of the pass in progress, from first on
+typedef struct {
+	HittableList* world;
+	Picture* pic;
+	Sampler* sampler;
+	int first;
+	int count;
+	unsigned epoch;
+	atomic_int claimed; // tiles handed out. every one of them gets traced, so they're always first, first + 1, ...
+	atomic_llong traced;
+	atomic_int finished;
+} RenderBatch;
+
+// the job's index is ignored: a tile is only claimed after checking for preemption, so whatever got traced when the
+// batch stops early is a run of tiles the pass can carry on after
+void render_tileJob(void* arg, int i) {
+	RenderBatch* b = (RenderBatch*)arg;
+	if (render_stale(b->epoch) || render_preempted()) return;
+	int tile = atomic_fetch_add(&b->claimed, 1);
+	if (tile >= b->count) return;
+	bool finished;
+	atomic_fetch_add(&b->traced, render_tile(b->world, b->pic, b->sampler, b->first + tile, b->epoch, &finished));
+	if (finished) atomic_fetch_add(&b->finished, 1);
+}
+
+// traces the next count tiles of the pass in progress on all threads, starting a pass first if there isn't one
+// going and finishing it if that was its last tile. returns how many tiles that was, fewer than count if something
+// more urgent came up. a cancelled batch keeps the samples that made it in, but doesn't move the pass along: the
+// picture is on its way out anyway
+int render_tiles(HittableList* world, Picture* pic, Sampler* sampler, int count) {
+	unsigned epoch = render_generation();
+	if (pic->next_tile == 0) {
+		render_hits(world, pic);
+	}
+
+	RenderBatch b = {world, pic, sampler, pic->next_tile, count, epoch};
+	atomic_init(&b.claimed, 0);
+	atomic_init(&b.traced, 0);
+	atomic_init(&b.finished, 0);
+	Jobs_parallelFor(count, render_tileJob, &b);
+	pic->samples_traced += atomic_load(&b.traced);
+	pic->tiles_left -= atomic_load(&b.finished);
+	if (render_stale(epoch)) return 0;
+	int claimed = atomic_load(&b.claimed);
+	count = claimed < count ? claimed : count;
+	pic->next_tile += count;
+
+	if (pic->next_tile == Picture_tileCount(pic)) {
+		pic->next_tile = 0;
+		if (pic->preview_step > 0) {
+			pic->preview_step /= 2;
+			if (pic->preview_step == 0) pic->sample_count++;
+		}
+		else {
+			pic->sample_count++;
+		}
+	}
+	return count;
+}
+
+// one more sample for every pixel in every tile that hasn't converged yet, or the rest of the pass in progress.
+// during a preview it's one step of it, and the pass only counts once the last step is done
+void render_pass(HittableList* world, Picture* pic, Sampler* sampler) {
+	if (render_done(pic)) return;
+	render_tiles(world, pic, sampler, Picture_tileCount(pic) - pic->next_tile);
+}
+
+// seconds it takes to trace a sample with every thread on it, learned from how long batches take
+double render_sample_time = 1e-5; // on the slow side, so the first frame doesn't overshoot
+
+double render_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// samples tracing the tile would take right now
+int render_tileSamples(Picture* pic, int tile) {
+	if (!render_tileWanted(pic, tile)) return 0;
+	int x0, y0, x1, y1;
+	Picture_tileBounds(pic, tile, &x0, &y0, &x1, &y1);
+	int step = pic->preview_step > 0 ? pic->preview_step : 1;
+	return ((x1 - x0 + step - 1) / step) * ((y1 - y0 + step - 1) / step);
+}
+
+// traces as many tiles as fit in budget seconds, passes after passes if there's time, instead of one pass per frame.
+// the first batch always goes, so a frame makes progress even when a single tile doesn't fit. returns early if the
+// work gets cancelled or something more urgent comes up
+void render_budget(HittableList* world, Picture* pic, Sampler* sampler, double budget) {
+	double start = render_now();
+	bool first = true;
+	unsigned epoch = render_generation();
+
+	while (!render_done(pic) && !render_stale(epoch) && !render_preempted()) {
+		double left = budget - (render_now() - start);
+		int tiles = Picture_tileCount(pic);
+		// keep adding tiles until the prediction says the next one wouldn't make it. a batch never crosses the end
+		// of a pass, since the next pass depends on how this one went
+		int count = 0;
+		long long samples = 0;
+		while (pic->next_tile + count < tiles) {
+			int more = render_tileSamples(pic, pic->next_tile + count);
+			if ((samples + more) * render_sample_time > left && !(first && samples == 0)) break;
+			samples += more;
+			count++;
+		}
+		if (count == 0) break;
+
+		double batch_start = render_now();
+		long long traced = pic->samples_traced;
+		render_tiles(world, pic, sampler, count);
+		traced = pic->samples_traced - traced;
+		// batches that were mostly skipped tiles (or cut short) don't say much about the cost of a sample
+		if (traced >= 1024 && !render_stale(epoch)) {
+			double measured = (render_now() - batch_start) / traced;
+			render_sample_time += 0.5 * (measured - render_sample_time);
+		}
+		first = false;
+	}
+}
+
+#endif
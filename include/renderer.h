@@ -0,0 +1,190 @@
+#ifndef RENDERER
+#define RENDERER
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "hittable_list.h"
+#include "picture.h"
+#include "sampler.h"
+#include "render.h"
+#include "denoise.h"
+#include "jobs.h"
+
+// traces the picture on a thread of its own, so the window keeps drawing and taking input while tiles are in
+// flight. the ui thread locks the renderer around everything that touches the picture, the world, the sampler or
+// the job pool (which only takes one batch at a time). the render thread always does the most urgent thing there
+// is (see RenderPriority): step aside for the ui, then denoise the picture if it's due, then trace it, then run
+// background jobs. a batch
+// of tiles stops at the next tile when the ui wants in, and a camera move locks with cancel set, which makes it
+// stop within a path instead (see render_cancel). the new picture for the move gets made on the render thread too,
+// as soon as the ui lets go (see Renderer_restart)
+
+#define RENDERER_QUEUE 16
+
+// background work, called with the renderer locked until it returns false. it should do a bit at a time, the
+// render thread can only get to more urgent things in between calls
+typedef struct {
+	bool (*fn)(void* arg);
+	void* arg;
+} RenderJob;
+
+typedef struct {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake; // the ui thread is done with the lock, there might be something new to render
+	bool running;
+	bool quit;
+	double slice; // seconds of tracing per go
+
+	// what to render, swapped only with the lock held
+	HittableList* world;
+	Picture* pic;
+	Picture* spare; // the picture before pic, whose buffers the next one gets (see render_restart)
+	Sampler* sampler;
+	Denoiser* denoiser; // NULL when denoising is off
+
+	// the new picture the ui asked for with Renderer_restart, which the render thread makes before anything else
+	bool restart;
+	bool restart_fresh; // without the old picture's samples
+	int width, height; // what size it's going to be. only the ui thread writes these, so it can read them unlocked
+	double restart_time; // seconds the last one took to make
+
+	RenderJob background[RENDERER_QUEUE]; // oldest first
+	int background_count;
+} Renderer;
+
+Renderer MakeRenderer(HittableList* world, Picture* pic, Picture* spare, Sampler* sampler, double slice) {
+	Renderer r = {0};
+	r.world = world;
+	r.pic = pic;
+	r.spare = spare;
+	r.sampler = sampler;
+	r.slice = slice;
+	return r;
+}
+
+// asks for a fresh width x height picture for the current camera, which replaces pic once the ui thread unlocks.
+// until then pic is the old one, so there's still something to show. with fresh set it starts from scratch instead
+// of with what's still visible of the old one, for when the old samples don't fit anymore (a new sampler). call
+// with the renderer locked, after locking with cancel set so the old picture isn't worked on any longer. asking
+// again before it's been made only changes what it's going to be
+void Renderer_restart(Renderer* r, int width, int height, bool fresh) {
+	r->restart = true;
+	r->restart_fresh = r->restart_fresh || fresh;
+	r->width = width;
+	r->height = height;
+}
+
+// queues fn to run once there's nothing more urgent to do. call with the renderer locked. false if the queue is full
+bool Renderer_background(Renderer* r, bool (*fn)(void* arg), void* arg) {
+	if (r->background_count == RENDERER_QUEUE) return false;
+	r->background[r->background_count++] = (RenderJob){fn, arg};
+	atomic_fetch_add(&render_waiting[RENDER_BACKGROUND], 1);
+	return true;
+}
+
+// one call of the oldest background job, which goes to the back of the queue if it isn't done yet
+void Renderer_runBackground(Renderer* r) {
+	RenderJob job = r->background[0];
+	r->background_count--;
+	memmove(&r->background[0], &r->background[1], r->background_count * sizeof(RenderJob));
+	if (job.fn(job.arg)) {
+		r->background[r->background_count++] = job;
+	}
+	else {
+		atomic_fetch_sub(&render_waiting[RENDER_BACKGROUND], 1);
+	}
+}
+
+void* Renderer_run(void* arg) {
+	Renderer* r = (Renderer*)arg;
+	pthread_mutex_lock(&r->lock);
+	while (!r->quit) {
+		// the ui's turn first, then the picture it asked for, before the old one gets any more samples
+		if (r->restart && atomic_load(&render_waiting[RENDER_INTERACTIVE]) == 0) {
+			if (r->restart_fresh) {
+				Picture_reset(r->pic, 0, 0);
+			}
+			double start = render_now();
+			render_restart(r->world, r->pic, r->spare, r->width, r->height);
+			r->restart_time = render_now() - start;
+			r->restart = r->restart_fresh = false;
+			continue;
+		}
+
+		bool denoising = r->denoiser != NULL && r->pic->width > 0 && Denoiser_pending(r->denoiser, r->pic);
+		bool rendering = r->pic->width > 0 && !render_done(r->pic);
+		if (atomic_load(&render_waiting[RENDER_INTERACTIVE]) > 0 || (!denoising && !rendering && atomic_load(&render_waiting[RENDER_BACKGROUND]) == 0)) {
+			pthread_cond_wait(&r->wake, &r->lock);
+			continue;
+		}
+
+		// a run is only due every so often (see Denoiser_wanted), and the picture gets no samples until it's done
+		if (denoising) {
+			if (r->denoiser->stage == DENOISE_IDLE) {
+				Denoiser_start(r->denoiser, r->pic);
+			}
+			Denoiser_step(r->denoiser, r->pic, r->slice);
+			continue;
+		}
+
+		if (!rendering) {
+			Renderer_runBackground(r);
+			continue;
+		}
+
+		render_budget(r->world, r->pic, r->sampler, r->slice);
+		if (render_done(r->pic)) {
+			printf("render done after %d passes, adaptive sampling skipped %.1f%% of the samples\r\n", r->pic->sample_count, 100 * render_savings(r->pic));
+		}
+	}
+	pthread_mutex_unlock(&r->lock);
+	return NULL;
+}
+
+void Renderer_start(Renderer* r) {
+	pthread_mutex_init(&r->lock, NULL);
+	pthread_cond_init(&r->wake, NULL);
+	r->quit = false;
+	r->running = pthread_create(&r->thread, NULL, Renderer_run, r) == 0;
+	if (!r->running) {
+		printf("couldn't start the render thread\r\n");
+	}
+}
+
+// takes the picture away from the render thread, as soon as the tiles in flight are done. with cancel set, those
+// are dropped rather than finished, for when the picture is about to be replaced
+void Renderer_lock(Renderer* r, bool cancel) {
+	// count as waiting before cancelling, or the render thread could start a fresh slice in between
+	atomic_fetch_add(&render_waiting[RENDER_INTERACTIVE], 1);
+	if (cancel) {
+		render_cancel();
+	}
+	pthread_mutex_lock(&r->lock);
+	atomic_fetch_sub(&render_waiting[RENDER_INTERACTIVE], 1);
+}
+
+void Renderer_unlock(Renderer* r) {
+	pthread_cond_signal(&r->wake);
+	pthread_mutex_unlock(&r->lock);
+}
+
+void Renderer_stop(Renderer* r) {
+	if (!r->running) return;
+	Renderer_lock(r, true);
+	r->quit = true;
+	r->restart = false;
+	// background jobs that didn't get to run are dropped
+	atomic_fetch_sub(&render_waiting[RENDER_BACKGROUND], r->background_count);
+	r->background_count = 0;
+	Renderer_unlock(r);
+	pthread_join(r->thread, NULL);
+	pthread_mutex_destroy(&r->lock);
+	pthread_cond_destroy(&r->wake);
+	r->running = false;
+}
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef RESOLUTION
+#define RESOLUTION
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+// dynamic resolution: while the camera moves, the picture is rendered smaller than its full size so the frame
+// rate holds, and the display scales it up (see Display_upscaleRow). once the camera stops it's back to full size
+// to refine. the scale is learned from how long frames take, and kept for the next time the camera moves
+
+#define RESOLUTION_STEPS 8 // the scale snaps to multiples of 1 / RESOLUTION_STEPS, so sizes don't change every frame
+
+typedef struct {
+	float scale; // picture size / full size per axis, while interacting
+	float min_scale;
+	float target; // seconds of work per frame to aim for
+	float ideal; // unsnapped scale the controller is converging to
+} ResolutionController;
+
+ResolutionController MakeResolutionController(int target_fps) {
+	ResolutionController r;
+	r.scale = 1.0f;
+	r.ideal = 1.0f;
+	r.min_scale = 0.25f;
+	// leave a bit of the frame for drawing and the rest of the loop
+	r.target = 0.8f / target_fps;
+	return r;
+}
+
+// feed it how long the last interactive frame took
+void Resolution_update(ResolutionController* r, double frame_time) {
+	if (frame_time <= 0) return;
+
+	// cost goes with the pixel count, so the scale that would've hit the target is sqrt(target / time) times
+	// this one. only go half way there so a single slow frame doesn't make it jump around
+	float wanted = r->scale * sqrtf(r->target / frame_time);
+	r->ideal += 0.5f * (wanted - r->ideal);
+	r->ideal = fminf(1.0f, fmaxf(r->min_scale, r->ideal));
+
+	// only snap to another step once the ideal is well past it, or it would flicker between two
+	float snapped = roundf(r->ideal * RESOLUTION_STEPS) / RESOLUTION_STEPS;
+	if (fabsf(r->ideal - r->scale) > 0.75f / RESOLUTION_STEPS) {
+		r->scale = fminf(1.0f, fmaxf(r->min_scale, snapped));
+	}
+}
+
+// size to render a full_width x full_height picture at; full size unless interacting
+void Resolution_size(ResolutionController* r, bool interacting, int full_width, int full_height, int* width, int* height) {
+	float scale = interacting ? r->scale : 1.0f;
+	*width = (int)(full_width * scale + 0.5f);
+	*height = (int)(full_height * scale + 0.5f);
+	if (*width < 1) *width = 1;
+	if (*height < 1) *height = 1;
+}
+
+#endif
@@ -0,0 +1,362 @@
+#ifndef SAMPLER
+#define SAMPLER
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "utils.h"
+#include "alloc.h"
+
+// samplers hand out the random numbers a path is built from.
+// every value is a pure function of (pixel, sample index, dimension), so the same path always gets the same
+// numbers no matter what order pixels are traced in, and samplers can spread samples out better than rand() can
+
+// which dimensions each part of a path reads
+#define DIM_PIXEL 0 // 2 dims: jitter inside the pixel
+#define DIM_LENS 2 // 2 dims: point on the lens
+#define DIM_BOUNCE 4 // first bounce starts here
+#define DIM_SCATTER 0 // 3 dims per bounce: material scatter
+#define DIM_LIGHT 3 // 3 dims per bounce: which light, and where on it
+#define DIM_ROULETTE 6 // 1 dim per bounce: russian roulette
+#define DIMS_PER_BOUNCE 7
+
+#define BLUE_NOISE_SIZE 64
+
+typedef struct {
+	uint32_t seed;
+} RandomSampler;
+
+typedef struct {
+	uint32_t seed;
+	int count; // how many samples each pixel will get, which is what gets stratified
+} StratifiedSampler;
+
+typedef struct {
+	uint32_t seed;
+} SobolSampler;
+
+typedef struct {
+	uint32_t seed;
+	float* mask; // BLUE_NOISE_SIZE x BLUE_NOISE_SIZE ranks in [0,1)
+} BlueNoiseSampler;
+
+typedef union {
+	RandomSampler random;
+	StratifiedSampler stratified;
+	SobolSampler sobol;
+	BlueNoiseSampler blue_noise;
+} SamplerObject;
+
+typedef struct {
+	SamplerObject object;
+	double (*sample)(SamplerObject o, int x, int y, uint32_t index, int dim); // returns a number in [0,1)
+	const char* name;
+} Sampler;
+
+// a single pixel sample in flight; the integrator pulls dimensions out of it in order
+typedef struct {
+	Sampler* sampler;
+	int x, y;
+	uint32_t index;
+	int dim;
+} PixelSample;
+
+double PixelSample_next(PixelSample* ps) {
+	return ps->sampler->sample(ps->sampler->object, ps->x, ps->y, ps->index, ps->dim++);
+}
+
+// hashing helpers
+
+uint32_t hash_u32(uint32_t x) { // "lowbias32" by chris wellons
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+uint32_t hash_combine(uint32_t seed, uint32_t v) {
+	return hash_u32(seed ^ (v + 0x9e3779b9u + (seed << 6) + (seed >> 2)));
+}
+
+uint32_t hash_pixel(uint32_t seed, int x, int y) {
+	return hash_combine(hash_combine(seed, (uint32_t)x), (uint32_t)y);
+}
+
+double u32_to_unit(uint32_t x) {
+	return x * (1.0 / 4294967296.0); // 2^-32, so never 1.0
+}
+
+uint32_t reverse_bits(uint32_t x) {
+	x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+	x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+	x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+	x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+	return (x >> 16) | (x << 16);
+}
+
+// random permutation of [0, len) picked by p, without a table (kensler 2013, "correlated multi-jittered sampling")
+uint32_t permute(uint32_t i, uint32_t len, uint32_t p) {
+	uint32_t w = len - 1;
+	w |= w >> 1;
+	w |= w >> 2;
+	w |= w >> 4;
+	w |= w >> 8;
+	w |= w >> 16;
+	do {
+		i ^= p; i *= 0xe170893d;
+		i ^= p >> 16;
+		i ^= (i & w) >> 4;
+		i ^= p >> 8; i *= 0x0929eb3f;
+		i ^= p >> 23;
+		i ^= (i & w) >> 1; i *= 1 | p >> 27;
+		i *= 0x6935fa69;
+		i ^= (i & w) >> 11; i *= 0x74dcb303;
+		i ^= (i & w) >> 2; i *= 0x9e501cc3;
+		i ^= (i & w) >> 2; i *= 0xc860a3df;
+		i &= w;
+		i ^= i >> 5;
+	} while (i >= len);
+	return (i + p) % len;
+}
+
+// owen scrambling in one go (burley 2020, "practical hash-based owen scrambling", with vegdahl's constants)
+uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) {
+	x = reverse_bits(x);
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return reverse_bits(x);
+}
+
+// white noise
+
+double RandomSampler_sample(SamplerObject o, int x, int y, uint32_t index, int dim) {
+	return u32_to_unit(hash_combine(hash_combine(hash_pixel(o.random.seed, x, y), index), (uint32_t)dim));
+}
+
+Sampler MakeRandomSampler(uint32_t seed) {
+	Sampler s;
+	s.object.random = (RandomSampler){seed};
+	s.sample = RandomSampler_sample;
+	s.name = "random";
+	return s;
+}
+
+// stratified: every dimension of a pixel is split into `count` strata and each sample lands in a different one.
+// the order the strata get visited in is shuffled per pixel and per dimension, so dimensions don't correlate
+
+double StratifiedSampler_sample(SamplerObject o, int x, int y, uint32_t index, int dim) {
+	StratifiedSampler s = o.stratified;
+	uint32_t round = index / s.count; // past `count` samples we start over with a new shuffle
+	uint32_t seed = hash_combine(hash_combine(hash_pixel(s.seed, x, y), (uint32_t)dim), round);
+
+	uint32_t stratum = permute(index % s.count, s.count, seed);
+	double jitter = u32_to_unit(hash_combine(seed, index));
+	return (stratum + jitter) / s.count;
+}
+
+Sampler MakeStratifiedSampler(uint32_t seed, int count) {
+	Sampler s;
+	s.object.stratified = (StratifiedSampler){seed, count > 0 ? count : 1};
+	s.sample = StratifiedSampler_sample;
+	s.name = "stratified";
+	return s;
+}
+
+// owen-scrambled sobol. dimensions are handed out 4 at a time from a 4d sobol sequence;
+// every group of 4 gets its own shuffled sample order so the groups don't correlate with each other
+
+uint32_t sobol_directions[4][32];
+bool sobol_ready = false;
+
+void sobol_init() {
+	// (s, a, m) for the first 4 dimensions from joe & kuo's new-joe-kuo-6.21201; the first one is just van der corput
+	const int s_list[4] = {0, 1, 2, 3};
+	const int a_list[4] = {0, 0, 1, 1};
+	const uint32_t m_list[4][3] = {{0}, {1}, {1, 3}, {1, 3, 1}};
+
+	for (int i = 0; i < 32; i++) {
+		sobol_directions[0][i] = 1u << (31 - i);
+	}
+
+	for (int d = 1; d < 4; d++) {
+		int s = s_list[d];
+		uint32_t* v = sobol_directions[d];
+		for (int i = 0; i < 32; i++) {
+			if (i < s) {
+				v[i] = m_list[d][i] << (31 - i);
+				continue;
+			}
+			v[i] = v[i - s] ^ (v[i - s] >> s);
+			for (int k = 1; k < s; k++) {
+				if ((a_list[d] >> (s - 1 - k)) & 1) v[i] ^= v[i - k];
+			}
+		}
+	}
+	sobol_ready = true;
+}
+
+uint32_t sobol(uint32_t index, int dim) {
+	uint32_t x = 0;
+	for (int bit = 0; index; index >>= 1, bit++) {
+		if (index & 1) x ^= sobol_directions[dim][bit];
+	}
+	return x;
+}
+
+uint32_t owen_sobol(uint32_t seed, uint32_t index, int dim) {
+	uint32_t group_seed = hash_combine(seed, (uint32_t)(dim / 4));
+	uint32_t shuffled = nested_uniform_scramble(index, group_seed);
+	return nested_uniform_scramble(sobol(shuffled, dim % 4), hash_combine(group_seed, (uint32_t)dim));
+}
+
+double SobolSampler_sample(SamplerObject o, int x, int y, uint32_t index, int dim) {
+	return u32_to_unit(owen_sobol(hash_pixel(o.sobol.seed, x, y), index, dim));
+}
+
+Sampler MakeSobolSampler(uint32_t seed) {
+	if (!sobol_ready) sobol_init();
+
+	Sampler s;
+	s.object.sobol = (SobolSampler){seed};
+	s.sample = SobolSampler_sample;
+	s.name = "sobol";
+	return s;
+}
+
+// blue noise dithered: every pixel runs the same owen-scrambled sobol sequence, shifted (mod 1) by a blue noise
+// mask. neighbouring pixels then get very different offsets, so whatever error is left looks like fine grain instead
+// of blotches, which is much less visible and much easier to filter away
+
+// void-and-cluster (ulichney 1993) on a torus. slow-ish, but it only runs once when the sampler gets made
+float* make_blue_noise_mask(uint32_t seed) {
+	const int size = BLUE_NOISE_SIZE;
+	const int n = size * size;
+	const double sigma = 1.5;
+
+	float* kernel = (float*)Alloc_malloc(n * sizeof(float)); // gaussian by toroidal offset
+	float* energy = (float*)Alloc_calloc(n, sizeof(float));
+	bool* on = (bool*)Alloc_calloc(n, sizeof(bool));
+	int* rank = (int*)Alloc_malloc(n * sizeof(int));
+	float* mask = (float*)Alloc_malloc(n * sizeof(float));
+
+	for (int dy = 0; dy < size; dy++) {
+		for (int dx = 0; dx < size; dx++) {
+			int wx = dx < size / 2 ? dx : size - dx;
+			int wy = dy < size / 2 ? dy : size - dy;
+			kernel[dy * size + dx] = exp(-(wx * wx + wy * wy) / (2 * sigma * sigma));
+		}
+	}
+
+	#define BLUE_NOISE_TOGGLE(p, value) { \
+		on[p] = value; \
+		int px = (p) % size, py = (p) / size; \
+		for (int q = 0; q < n; q++) { \
+			int dx = (q % size - px + size) % size; \
+			int dy = (q / size - py + size) % size; \
+			energy[q] += (value ? 1 : -1) * kernel[dy * size + dx]; \
+		} \
+	}
+
+	// tightest cluster = densest "on" pixel, largest void = emptiest "off" pixel
+	#define BLUE_NOISE_FIND(result, want_on, pick_max) { \
+		result = -1; \
+		for (int q = 0; q < n; q++) { \
+			if (on[q] != want_on) continue; \
+			if (result < 0 || (pick_max ? energy[q] > energy[result] : energy[q] < energy[result])) result = q; \
+		} \
+	}
+
+	// start from a random pattern with ~10% of pixels on, then shuffle points from clusters into voids until stable
+	int ones = 0;
+	for (int i = 0; i < n; i++) {
+		if (u32_to_unit(hash_combine(seed, i)) < 0.1) {
+			BLUE_NOISE_TOGGLE(i, true);
+			ones++;
+		}
+	}
+	while (true) {
+		int cluster, gap;
+		BLUE_NOISE_FIND(cluster, true, true);
+		BLUE_NOISE_TOGGLE(cluster, false);
+		BLUE_NOISE_FIND(gap, false, false);
+		BLUE_NOISE_TOGGLE(gap, true);
+		if (gap == cluster) break;
+	}
+
+	bool* initial = (bool*)Alloc_malloc(n * sizeof(bool));
+	memcpy(initial, on, n * sizeof(bool));
+	float* initial_energy = (float*)Alloc_malloc(n * sizeof(float));
+	memcpy(initial_energy, energy, n * sizeof(float));
+
+	// ranks below the initial pattern: peel off the tightest clusters
+	for (int r = ones - 1; r >= 0; r--) {
+		int cluster;
+		BLUE_NOISE_FIND(cluster, true, true);
+		BLUE_NOISE_TOGGLE(cluster, false);
+		rank[cluster] = r;
+	}
+
+	// ranks above it: keep filling the largest voids. (past half full this is the same as picking the tightest
+	// cluster of the remaining zeros, since the kernel sums to the same everywhere on a torus)
+	memcpy(on, initial, n * sizeof(bool));
+	memcpy(energy, initial_energy, n * sizeof(float));
+	for (int r = ones; r < n; r++) {
+		int gap;
+		BLUE_NOISE_FIND(gap, false, false);
+		BLUE_NOISE_TOGGLE(gap, true);
+		rank[gap] = r;
+	}
+
+	#undef BLUE_NOISE_TOGGLE
+	#undef BLUE_NOISE_FIND
+
+	for (int i = 0; i < n; i++) {
+		mask[i] = (rank[i] + 0.5f) / n;
+	}
+
+	Alloc_free(kernel);
+	Alloc_free(energy);
+	Alloc_free(on);
+	Alloc_free(rank);
+	Alloc_free(initial);
+	Alloc_free(initial_energy);
+	return mask;
+}
+
+double BlueNoiseSampler_sample(SamplerObject o, int x, int y, uint32_t index, int dim) {
+	BlueNoiseSampler b = o.blue_noise;
+	// every dimension reads the mask at a different offset (R2 sequence) so dimensions don't share their dither
+	int ox = (int)(fmod(dim * 0.7548776662466927, 1.0) * BLUE_NOISE_SIZE);
+	int oy = (int)(fmod(dim * 0.5698402909980532, 1.0) * BLUE_NOISE_SIZE);
+	int mx = ((x + ox) % BLUE_NOISE_SIZE + BLUE_NOISE_SIZE) % BLUE_NOISE_SIZE;
+	int my = ((y + oy) % BLUE_NOISE_SIZE + BLUE_NOISE_SIZE) % BLUE_NOISE_SIZE;
+
+	double v = u32_to_unit(owen_sobol(b.seed, index, dim)) + b.mask[my * BLUE_NOISE_SIZE + mx];
+	v -= floor(v);
+	return v < 1.0 ? v : 0.0;
+}
+
+Sampler MakeBlueNoiseSampler(uint32_t seed) {
+	if (!sobol_ready) sobol_init();
+
+	Sampler s;
+	s.object.blue_noise = (BlueNoiseSampler){seed, make_blue_noise_mask(seed)};
+	s.sample = BlueNoiseSampler_sample;
+	s.name = "blue noise";
+	return s;
+}
+
+void Sampler_free(Sampler* s) {
+	if (s->sample == BlueNoiseSampler_sample) {
+		Alloc_free(s->object.blue_noise.mask);
+		s->object.blue_noise.mask = NULL;
+	}
+}
+
+#endif
@@ -28,19 +28,14 @@ HittableList sexy_scene() {
 	HittableList_add(&world, MakeSphere(point3(0.1, 1, -1.5), 0.34, metal));
 	HittableList_add(&world, MakeSphere(point3(0.1, 1, 0.5), 0.34, purpleglow));
 
-	printf("building BVH...\r\n");
-
 	HittableList_buildBVH(&world);
-
-	printf("BVH built!\r\n BVH:\r\n");
-	BVHNode_print(world.first_child->object, "");
 	// printf("BVH built!\r\n\tworld:\r\n");
 
 	// HittableList_print(&world, "\t");
 
 
-	Vector3 lookfrom = vec3(3, 3, 2);
-	Vector3 lookat = vec3(0, 0, -1);
+	Vec3 lookfrom = vec3(3, 3, 2);
+	Vec3 lookat = vec3(0, 0, -1);
 
 	world.camera = MakeCamera(
 		lookfrom, // origin
@@ -48,7 +43,7 @@ HittableList sexy_scene() {
 		vec3(0, 1, 0), // up
 		50, // fov
 		0, // aperture
-		Vector3Length(Vector3Subtract(lookfrom, lookat)), // we focus on the point we're looking at
+		Vec3Length(Vec3Subtract(lookfrom, lookat)), // we focus on the point we're looking at
 		0, // image width
 		0 // image height
 	);
@@ -64,18 +59,18 @@ HittableList random_scene() {
 	for (int a = -11; a < 11; a++) {
 		for (int b = -11; b < 11; b++) {
 			double choose_mat = random_double1();
-			Vector3 center = vec3(a + 0.9*random_double1(), 0.2, b + 0.9*random_double1());
+			Vec3 center = vec3(a + 0.9*random_double1(), 0.2, b + 0.9*random_double1());
 
-			if (Vector3Length(Vector3Subtract(center, point3(4, 0.2, 0))) > 0.9) {
+			if (Vec3Length(Vec3Subtract(center, point3(4, 0.2, 0))) > 0.9) {
 				if (choose_mat < 0.8) {
 					// lambertian
-					Vector3 albedo = Vector3Multiply(random_color(), random_color());
+					Vec3 albedo = Vec3Multiply(random_color(), random_color());
 					int m = HittableList_addMat(&world, MakeLambertian(albedo));
 					HittableList_add(&world, MakeSphere(center, 0.2, m));
 				}
 				else if (choose_mat < 0.95) {
 					// metal
-					Vector3 albedo = Vector3RandRange(0.5, 1);
+					Vec3 albedo = Vec3RandRange(0.5, 1);
 					float r = random_double1();
 					int m = HittableList_addMat(&world, MakeMetal(albedo, r));
 					HittableList_add(&world, MakeSphere(center, 0.2, m));
@@ -103,12 +98,11 @@ HittableList random_scene() {
 	// HittableList_print(&world, "\t");
 
 	HittableList_buildBVH(&world);
-	BVHNode_print(world.first_child->object, "");
 
 	// printf("number of objects: %d\r\nnumber of BVH nodes: %d\r\n", world.len);
 
-	Vector3 lookfrom = point3(13, 2, 3);
-	Vector3 lookat = point3(0, 0, 0);
+	Vec3 lookfrom = point3(13, 2, 3);
+	Vec3 lookat = point3(0, 0, 0);
 
 	world.camera = MakeCamera(
 		lookfrom, // origin
@@ -116,7 +110,7 @@ HittableList random_scene() {
 		vec3(0, 1, 0), // up
 		20, // fov
 		0.1, // aperture
-		Vector3Length(Vector3Subtract(lookfrom, lookat)), // we focus on the point we're looking at
+		Vec3Length(Vec3Subtract(lookfrom, lookat)), // we focus on the point we're looking at
 		0, // image width
 		0 // image height
 	);
@@ -137,8 +131,8 @@ HittableList bright_light_scene() {
 
 	HittableList_buildBVH(&world);
 
-	Vector3 lookfrom = vec3(3, 3, 2);
-	Vector3 lookat = vec3(0, 0, -1);
+	Vec3 lookfrom = vec3(3, 3, 2);
+	Vec3 lookat = vec3(0, 0, -1);
 
 	world.camera = MakeCamera(
 		lookfrom, // origin
@@ -146,7 +140,7 @@ HittableList bright_light_scene() {
 		vec3(0, 1, 0), // up
 		50, // fov
 		0, // aperture
-		Vector3Length(Vector3Subtract(lookfrom, lookat)), // we focus on the point we're looking at
+		Vec3Length(Vec3Subtract(lookfrom, lookat)), // we focus on the point we're looking at
 		0, // image width
 		0 // image height
 	);
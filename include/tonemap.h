@@ -0,0 +1,121 @@
+#ifndef TONEMAP
+#define TONEMAP
+#include "raylib.h"
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "utils.h"
+
+// turns linear radiance into 8 bit colors for the screen: exposure, then a tonemap operator, then gamma 2 like
+// Vec3ToColor. the SSE version does a whole pixel per instruction (the padding lane becomes alpha) and packs
+// 4 pixels at a time down to bytes
+
+#ifdef VEC3_SSE
+#include <emmintrin.h>
+#endif
+
+typedef enum {
+	TONEMAP_CLAMP, // what Vec3ToColor does, anything over 1 clips
+	TONEMAP_REINHARD, // x / (1 + x)
+	TONEMAP_ACES, // narkowicz's fit of the ACES filmic curve
+	TONEMAP_COUNT
+} TonemapOperator;
+
+const char* tonemap_names[TONEMAP_COUNT] = {"clamp", "reinhard", "aces"};
+
+typedef struct {
+	float exposure; // in stops
+	TonemapOperator op;
+} Tonemap;
+
+Tonemap MakeTonemap() {
+	return (Tonemap){0.0f, TONEMAP_CLAMP};
+}
+
+bool Tonemap_equal(Tonemap a, Tonemap b) {
+	return a.exposure == b.exposure && a.op == b.op;
+}
+
+#ifdef VEC3_SSE
+static inline __m128 Tonemap_curve(__m128 x, TonemapOperator op) {
+	switch (op) {
+		case TONEMAP_REINHARD:
+			return _mm_div_ps(x, _mm_add_ps(x, _mm_set1_ps(1.0f)));
+		case TONEMAP_ACES: {
+			__m128 a = _mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(2.51f)), _mm_set1_ps(0.03f)));
+			__m128 b = _mm_add_ps(_mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(2.43f)), _mm_set1_ps(0.59f))), _mm_set1_ps(0.14f));
+			return _mm_div_ps(a, b);
+		}
+		default:
+			return x;
+	}
+}
+
+// linear color to 0..255 in each lane, with the padding lane forced to 1 so it comes out as alpha 255
+static inline __m128i Tonemap_quantize(__m128 c, float scale, TonemapOperator op) {
+	const __m128 alpha = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+	__m128 x = _mm_max_ps(_mm_mul_ps(c, _mm_set1_ps(scale)), _mm_setzero_ps());
+	x = _mm_sqrt_ps(Tonemap_curve(x, op));
+	x = _mm_or_ps(_mm_andnot_ps(alpha, x), _mm_and_ps(alpha, _mm_set1_ps(1.0f)));
+	x = _mm_mul_ps(_mm_min_ps(x, _mm_set1_ps(0.999f)), _mm_set1_ps(256.0f));
+	return _mm_cvttps_epi32(x);
+}
+
+// sums have their sample weight in the w lane (see Picture), everything else is already a mean
+static inline __m128 Tonemap_mean(__m128 sum) {
+	__m128 weight = _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(3, 3, 3, 3));
+	return _mm_div_ps(sum, _mm_max_ps(weight, _mm_set1_ps(1e-20f)));
+}
+
+// converts count pixels from in to out. weighted says whether in holds weighted sums or plain colors
+void Tonemap_row(Tonemap tm, const Vec3* in, Color* out, int count, bool weighted) {
+	float scale = exp2f(tm.exposure);
+	int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i p[4];
+		for (int k = 0; k < 4; k++) {
+			__m128 c = weighted ? Tonemap_mean(in[i + k].m) : in[i + k].m;
+			p[k] = Tonemap_quantize(c, scale, tm.op);
+		}
+		__m128i bytes = _mm_packus_epi16(_mm_packs_epi32(p[0], p[1]), _mm_packs_epi32(p[2], p[3]));
+		_mm_storeu_si128((__m128i*)(out + i), bytes);
+	}
+	for (; i < count; i++) {
+		__m128 c = weighted ? Tonemap_mean(in[i].m) : in[i].m;
+		__m128i p = Tonemap_quantize(c, scale, tm.op);
+		uint32_t packed = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(p, p), p));
+		memcpy(out + i, &packed, sizeof(Color));
+	}
+}
+#else
+float Tonemap_curve(float x, TonemapOperator op) {
+	switch (op) {
+		case TONEMAP_REINHARD:
+			return x / (1.0f + x);
+		case TONEMAP_ACES:
+			return (x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f);
+		default:
+			return x;
+	}
+}
+
+unsigned char Tonemap_quantize(float x, float scale, TonemapOperator op) {
+	x = sqrtf(Tonemap_curve(fmaxf(x * scale, 0.0f), op));
+	return (unsigned char)(fminf(x, 0.999f) * 256.0f);
+}
+
+void Tonemap_row(Tonemap tm, const Vec3* in, Color* out, int count, bool weighted) {
+	float scale = exp2f(tm.exposure);
+	for (int i = 0; i < count; i++) {
+		float s = weighted ? (in[i].w > 0 ? scale / in[i].w : 0) : scale;
+		out[i] = (Color){
+			Tonemap_quantize(in[i].x, s, tm.op),
+			Tonemap_quantize(in[i].y, s, tm.op),
+			Tonemap_quantize(in[i].z, s, tm.op),
+			255
+		};
+	}
+}
+#endif
+
+#endif
@@ -3,72 +3,35 @@
 
 #include "raylib.h"
 #include "raymath.h"
+#include "vec3.h"
 #include <stdlib.h>
+#include "alloc.h"
 #include <stdio.h>
 #include <math.h>
 #include <time.h>
 
-#define color(r,g,b) ((Vector3){r,g,b})
-#define vec3(x,y,z) ((Vector3){x,y,z})
-#define point3(x,y,z) ((Vector3){x,y,z})
-#define dot(a,b) (a.x*b.x + a.y*b.y + a.z*b.z)
+#define color(r,g,b) Vec3Make(r,g,b)
+#define vec3(x,y,z) Vec3Make(x,y,z)
+#define point3(x,y,z) Vec3Make(x,y,z)
+#define dot(a,b) Vec3DotProduct(a,b)
 #define pi (double)3.1415926535897932385
 #define degrees_to_radians(d) (d * pi / 180.0f)
 #define ndigits(i) ((int)(i != 0 ? floor(log10(abs(i))) + 1 : 1))
-#define ray(o, v) ((Ray){o, v})
+#define ray(o, v) ((Ray3){o, v})
 #define printvector(v) (printf("(%f, %f, %f)", v.x, v.y, v.z))
-#define random_color() Vector3Random()
-#define vec2arr(v) {v.x, v.y, v.z} // this is a little iffy
+#define random_color() Vec3Random()
 #define logbasen(n, x) (log(x) / log(n))
 
-typedef struct {
-	int width;
-	int height;
-	int sample_count;
-	Vector3** color;
-} Picture;
-
-Picture MakePicture(int width, int height) {
-	Picture p = {
-		width,
-		height,
-		0
-	};
-
-	p.color = (Vector3**)malloc(width * sizeof(Vector3*));
-
-	for (int i = 0; i < width; i++) {
-		p.color[i] = (Vector3*)malloc(height * sizeof(Vector3));
-	}
-
-	return p;
+Vec3 Ray_at(Ray3 r, double t) {
+	return Vec3Add(r.position, Vec3Scale(r.direction, t));
 }
 
-Vector3 Picture_at(Picture *p, int u, int v) {
-	return p->color[u][v];
+Vec3 UnitVector(Vec3 v) {
+	return Vec3Normalize(v);
 }
 
-void Picture_set(Picture *p, int u, int v, Vector3 color) {
-	p->color[u][v] = color;
-}
-
-void Picture_free(Picture *p) {
-	for (int i = 0; i < p->width; i++) {
-		free(p->color[i]);
-	}
-
-	free(p->color);
-	p->sample_count = 0;
-	p->width = 0.0;
-	p->height = 0.0;
-}
-
-Vector3 Ray_at(Ray r, double t) {
-	return Vector3Add(r.position, Vector3Scale(r.direction, t));
-}
-
-Vector3 UnitVector(Vector3 v) {
-	return Vector3Scale(v, 1.0f/Vector3Length(v));
+double luminance(Vec3 c) {
+	return 0.2126 * c.x + 0.7152 * c.y + 0.0722 * c.z;
 }
 
 double clamp(double x, double min, double max) {
@@ -77,11 +40,8 @@ double clamp(double x, double min, double max) {
     return x;
 }
 
-Color Vector3ToColor(Vector3 v, double s) {
-	v = Vector3Scale(v, s);
-	v.x = sqrt(v.x);
-	v.y = sqrt(v.y);
-	v.z = sqrt(v.z);
+Color Vec3ToColor(Vec3 v, double s) {
+	v = Vec3Sqrt(Vec3Max(Vec3Scale(v, s), Vec3Zero()));
 	return (Color){
 		(int)(clamp(v.x, 0.0, 0.999) * 256),
 		(int)(clamp(v.y, 0.0, 0.999) * 256),
@@ -100,38 +60,77 @@ double random_double(double min, double max) {
     return min + (max-min)*random_double1();
 }
 
-Vector3 Vector3Random() {
+Vec3 Vec3Random() {
 	return vec3((float)random_double1(), (float)random_double1(), (float)random_double1());
 }
 
-Vector3 Vector3RandRange(double min, double max) {
+Vec3 Vec3RandRange(double min, double max) {
 	return vec3((float)random_double(min, max), (float)random_double(min, max), (float)random_double(min, max));
 }
 
-Vector3 random_in_unit_sphere() {
-	while (true) {
-		Vector3 p = Vector3RandRange(-1, 1);
-		if (Vector3LengthSqr(p) >= 1) continue;
-		return p;
-	}
+// closed-form samplers. each one maps uniform numbers in [0,1) straight to a point, so they always cost the same,
+// never loop, and work with stratified / low discrepancy sample values as well as with rand()
+
+Vec3 sample_uniform_sphere(double u1, double u2) {
+	double z = 1.0 - 2.0 * u1;
+	double r = sqrt(fmax(0.0, 1.0 - z * z));
+	double phi = 2 * pi * u2;
+	return vec3(r * cos(phi), r * sin(phi), z);
 }
 
-Vector3 random_in_unit_disk() {
-	while (true) {
-		Vector3 p = vec3((float)random_double(-1, 1), (float)random_double(-1, 1), 0);
-		if (Vector3LengthSqr(p) >= 1) continue;
-		return p;
-	}
+Vec3 sample_in_unit_sphere(double u1, double u2, double u3) {
+	return Vec3Scale(sample_uniform_sphere(u1, u2), cbrt(u3));
 }
 
-Vector3 random_unit_vector() {
-    return UnitVector(random_in_unit_sphere());
+// shirley-chiu concentric mapping; unlike the polar mapping it keeps neighbouring samples next to each other
+Vec3 sample_concentric_disk(double u1, double u2) {
+	double a = 2.0 * u1 - 1.0;
+	double b = 2.0 * u2 - 1.0;
+
+	bool x_major = fabs(a) > fabs(b);
+	double r = x_major ? a : b;
+	// when b is 0 here, so is a, so r = 0 and theta doesn't matter
+	double theta = x_major ? (pi / 4) * (b / a) : (pi / 2) - (pi / 4) * (a / (b != 0 ? b : 1));
+	return vec3(r * cos(theta), r * sin(theta), 0);
+}
+
+// cosine weighted direction around +z (malley's method: project the disk up onto the hemisphere). pdf is z / pi
+Vec3 sample_cosine_hemisphere(double u1, double u2) {
+	Vec3 d = sample_concentric_disk(u1, u2);
+	d.z = sqrt(fmax(0.0, 1.0 - d.x * d.x - d.y * d.y));
+	return d;
+}
+
+// rotates a direction sampled around +z so that it's around n instead
+Vec3 to_world(Vec3 local, Vec3 n) {
+	Vec3 u, v;
+	Vec3OrthonormalBasis(n, &u, &v);
+	return Vec3Add(Vec3Add(Vec3Scale(u, local.x), Vec3Scale(v, local.y)), Vec3Scale(n, local.z));
+}
+
+Vec3 random_in_unit_sphere() {
+	return sample_in_unit_sphere(random_double1(), random_double1(), random_double1());
+}
+
+Vec3 random_in_unit_disk() {
+	return sample_concentric_disk(random_double1(), random_double1());
+}
+
+Vec3 random_unit_vector() {
+	return sample_uniform_sphere(random_double1(), random_double1());
 }
 
 int randint(int min, int max) {
 	return (rand() / (RAND_MAX)) * (max - min) + min;
 }
 
+// multiple importance sampling weight for a sample from strategy f when strategy g could also have produced it
+double power_heuristic(double f_pdf, double g_pdf) {
+	double f2 = f_pdf * f_pdf;
+	double g2 = g_pdf * g_pdf;
+	return f2 + g2 > 0 ? f2 / (f2 + g2) : 0;
+}
+
 double reflectance(double cosine, double ref_index) { // schlick approximation
 	double r0 = (1 - ref_index) / (1 + ref_index);
 	r0 = r0 * r0;
@@ -0,0 +1,233 @@
+#ifndef VEC3
+#define VEC3
+
+#include "raylib.h"
+#include <math.h>
+
+// SIMD-backed vector type used by all of the tracing code.
+// raylib's Vector3 is only used at the display boundary (see Vec3ToVector3 / Vec3FromVector3)
+// the 4th lane is padding and is kept at 0 so that a Vec3 fits in a single SSE register
+
+#if (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)) && !defined(VEC3_NO_SIMD)
+#define VEC3_SSE
+#include <xmmintrin.h>
+#endif
+
+typedef union {
+#ifdef VEC3_SSE
+	__m128 m;
+#endif
+	struct {
+		float x, y, z, w;
+	};
+	float e[4];
+} Vec3;
+
+typedef struct {
+	Vec3 position;
+	Vec3 direction;
+} Ray3;
+
+#ifdef VEC3_SSE
+#define VEC3_WRAP(v) ((Vec3){.m = (v)})
+
+static inline Vec3 Vec3Make(float x, float y, float z) {
+	return VEC3_WRAP(_mm_set_ps(0.0f, z, y, x));
+}
+
+static inline Vec3 Vec3Zero(void) {
+	return VEC3_WRAP(_mm_setzero_ps());
+}
+
+static inline Vec3 Vec3One(void) {
+	return Vec3Make(1.0f, 1.0f, 1.0f);
+}
+
+static inline Vec3 Vec3Add(Vec3 a, Vec3 b) {
+	return VEC3_WRAP(_mm_add_ps(a.m, b.m));
+}
+
+static inline Vec3 Vec3Subtract(Vec3 a, Vec3 b) {
+	return VEC3_WRAP(_mm_sub_ps(a.m, b.m));
+}
+
+static inline Vec3 Vec3Multiply(Vec3 a, Vec3 b) {
+	return VEC3_WRAP(_mm_mul_ps(a.m, b.m));
+}
+
+static inline Vec3 Vec3Divide(Vec3 a, Vec3 b) {
+	// the padding lane would be 0/0, so divide it by 1 instead
+	return VEC3_WRAP(_mm_div_ps(a.m, _mm_add_ps(b.m, _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f))));
+}
+
+static inline Vec3 Vec3Scale(Vec3 v, float s) {
+	return VEC3_WRAP(_mm_mul_ps(v.m, _mm_set1_ps(s)));
+}
+
+static inline Vec3 Vec3Negate(Vec3 v) {
+	return VEC3_WRAP(_mm_sub_ps(_mm_setzero_ps(), v.m));
+}
+
+static inline Vec3 Vec3Min(Vec3 a, Vec3 b) {
+	return VEC3_WRAP(_mm_min_ps(a.m, b.m));
+}
+
+static inline Vec3 Vec3Max(Vec3 a, Vec3 b) {
+	return VEC3_WRAP(_mm_max_ps(a.m, b.m));
+}
+
+static inline Vec3 Vec3Sqrt(Vec3 v) {
+	return VEC3_WRAP(_mm_sqrt_ps(v.m));
+}
+
+static inline float Vec3DotProduct(Vec3 a, Vec3 b) {
+	__m128 p = _mm_mul_ps(a.m, b.m); // padding lane is 0
+	__m128 s = _mm_add_ps(p, _mm_movehl_ps(p, p)); // (x+z, y+w)
+	s = _mm_add_ss(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 1, 1, 1)));
+	return _mm_cvtss_f32(s);
+}
+
+static inline Vec3 Vec3CrossProduct(Vec3 a, Vec3 b) {
+	__m128 a_yzx = _mm_shuffle_ps(a.m, a.m, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 b_yzx = _mm_shuffle_ps(b.m, b.m, _MM_SHUFFLE(3, 0, 2, 1));
+	__m128 c = _mm_sub_ps(_mm_mul_ps(a.m, b_yzx), _mm_mul_ps(a_yzx, b.m));
+	return VEC3_WRAP(_mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1)));
+}
+
+static inline float Vec3LengthSqr(Vec3 v) {
+	return Vec3DotProduct(v, v);
+}
+
+static inline float Vec3Length(Vec3 v) {
+	return _mm_cvtss_f32(_mm_sqrt_ss(_mm_set_ss(Vec3DotProduct(v, v))));
+}
+
+static inline float Vec3MinComponent(Vec3 v) {
+	__m128 m = _mm_min_ps(v.m, _mm_shuffle_ps(v.m, v.m, _MM_SHUFFLE(3, 0, 2, 1)));
+	return _mm_cvtss_f32(_mm_min_ss(m, _mm_shuffle_ps(v.m, v.m, _MM_SHUFFLE(3, 1, 0, 2))));
+}
+
+static inline float Vec3MaxComponent(Vec3 v) {
+	__m128 m = _mm_max_ps(v.m, _mm_shuffle_ps(v.m, v.m, _MM_SHUFFLE(3, 0, 2, 1)));
+	return _mm_cvtss_f32(_mm_max_ss(m, _mm_shuffle_ps(v.m, v.m, _MM_SHUFFLE(3, 1, 0, 2))));
+}
+#else
+static inline Vec3 Vec3Make(float x, float y, float z) {
+	return (Vec3){.x = x, .y = y, .z = z, .w = 0.0f};
+}
+
+static inline Vec3 Vec3Zero(void) {
+	return Vec3Make(0.0f, 0.0f, 0.0f);
+}
+
+static inline Vec3 Vec3One(void) {
+	return Vec3Make(1.0f, 1.0f, 1.0f);
+}
+
+static inline Vec3 Vec3Add(Vec3 a, Vec3 b) {
+	return Vec3Make(a.x + b.x, a.y + b.y, a.z + b.z);
+}
+
+static inline Vec3 Vec3Subtract(Vec3 a, Vec3 b) {
+	return Vec3Make(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+static inline Vec3 Vec3Multiply(Vec3 a, Vec3 b) {
+	return Vec3Make(a.x * b.x, a.y * b.y, a.z * b.z);
+}
+
+static inline Vec3 Vec3Divide(Vec3 a, Vec3 b) {
+	return Vec3Make(a.x / b.x, a.y / b.y, a.z / b.z);
+}
+
+static inline Vec3 Vec3Scale(Vec3 v, float s) {
+	return Vec3Make(v.x * s, v.y * s, v.z * s);
+}
+
+static inline Vec3 Vec3Negate(Vec3 v) {
+	return Vec3Make(-v.x, -v.y, -v.z);
+}
+
+static inline Vec3 Vec3Min(Vec3 a, Vec3 b) {
+	return Vec3Make(fminf(a.x, b.x), fminf(a.y, b.y), fminf(a.z, b.z));
+}
+
+static inline Vec3 Vec3Max(Vec3 a, Vec3 b) {
+	return Vec3Make(fmaxf(a.x, b.x), fmaxf(a.y, b.y), fmaxf(a.z, b.z));
+}
+
+static inline Vec3 Vec3Sqrt(Vec3 v) {
+	return Vec3Make(sqrtf(v.x), sqrtf(v.y), sqrtf(v.z));
+}
+
+static inline float Vec3DotProduct(Vec3 a, Vec3 b) {
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static inline Vec3 Vec3CrossProduct(Vec3 a, Vec3 b) {
+	return Vec3Make(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+static inline float Vec3LengthSqr(Vec3 v) {
+	return Vec3DotProduct(v, v);
+}
+
+static inline float Vec3Length(Vec3 v) {
+	return sqrtf(Vec3DotProduct(v, v));
+}
+
+static inline float Vec3MinComponent(Vec3 v) {
+	return fminf(v.x, fminf(v.y, v.z));
+}
+
+static inline float Vec3MaxComponent(Vec3 v) {
+	return fmaxf(v.x, fmaxf(v.y, v.z));
+}
+#endif
+
+// everything below is built on the kernels above, so it is the same for both backends
+
+static inline Vec3 Vec3Normalize(Vec3 v) {
+	return Vec3Scale(v, 1.0f / Vec3Length(v));
+}
+
+static inline Vec3 Vec3Lerp(Vec3 a, Vec3 b, float t) {
+	return Vec3Add(a, Vec3Scale(Vec3Subtract(b, a), t));
+}
+
+static inline Vec3 Vec3Reflect(Vec3 v, Vec3 normal) {
+	return Vec3Subtract(v, Vec3Scale(normal, 2.0f * Vec3DotProduct(v, normal)));
+}
+
+// v and normal must be unit vectors
+static inline Vec3 Vec3Refract(Vec3 v, Vec3 normal, float eta) {
+	float cos_theta = fminf(-Vec3DotProduct(v, normal), 1.0f);
+	Vec3 r_out_perp = Vec3Scale(Vec3Add(v, Vec3Scale(normal, cos_theta)), eta);
+	Vec3 r_out_parallel = Vec3Scale(normal, -sqrtf(fabsf(1.0f - Vec3LengthSqr(r_out_perp))));
+	return Vec3Add(r_out_perp, r_out_parallel);
+}
+
+// builds u and v so that (u, v, n) is an orthonormal basis. n must be a unit vector
+// (branchless version from Duff et al. 2017)
+static inline void Vec3OrthonormalBasis(Vec3 n, Vec3* u, Vec3* v) {
+	float sign = copysignf(1.0f, n.z);
+	float a = -1.0f / (sign + n.z);
+	float b = n.x * n.y * a;
+	*u = Vec3Make(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+	*v = Vec3Make(b, sign + n.y * n.y * a, -n.y);
+}
+
+static inline bool Vec3NearZero(Vec3 v) {
+	const float s = 1e-8f;
+	return fabsf(v.x) < s && fabsf(v.y) < s && fabsf(v.z) < s;
+}
+
+static inline Vec3 Vec3FromVector3(Vector3 v) {
+	return Vec3Make(v.x, v.y, v.z);
+}
+
+static inline Vector3 Vec3ToVector3(Vec3 v) {
+	return (Vector3){v.x, v.y, v.z};
+}
+
+#endif
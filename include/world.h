@@ -8,13 +8,14 @@
 #include <time.h>
 #include <string.h>
 #include "utils.h"
+#include "arena.h"
 #include "camera.h"
 
 typedef struct Mat Mat;
 
 typedef struct {
-	Vector3 p;
-	Vector3 normal;
+	Vec3 p;
+	Vec3 normal;
 	double t;
 	bool front_face;
 	int mat_i;
@@ -23,13 +24,13 @@ typedef struct {
 // object type definitions
 typedef struct {
 	double radius;
-	Vector3 center;
+	Vec3 center;
 	int mat_i;
 } Sphere;
 
 typedef struct {
-	Vector3 minimum;
-	Vector3 maximum;
+	Vec3 minimum;
+	Vec3 maximum;
 } Aabb;
 
 typedef struct {
@@ -46,22 +47,24 @@ typedef union {
 
 typedef struct {
 	HittableObject object;
-	bool (*hit)(HittableObject o, const Ray r, double t_min, double t_max, HitRecord *rec);
+	bool (*hit)(HittableObject o, const Ray3 r, double t_min, double t_max, HitRecord *rec);
+	// any-hit version of hit() for shadow rays: true as soon as anything is found in (t_min, t_max)
+	bool (*occluded)(HittableObject o, const Ray3 r, double t_min, double t_max);
 	bool (*bounding_box)(HittableObject o, Aabb* output_box);
 	void (*print)(HittableObject o, char* tab);
 } Hittable;
 
-void set_face_normal(HitRecord *rec, const Ray r, const Vector3 outward_normal) {
+void set_face_normal(HitRecord *rec, const Ray3 r, const Vec3 outward_normal) {
 	rec->front_face = dot(r.direction, outward_normal) < 0;
-	rec->normal = rec->front_face ? outward_normal : Vector3Negate(outward_normal);
+	rec->normal = rec->front_face ? outward_normal : Vec3Negate(outward_normal);
 }
 
-bool Sphere_hit(HittableObject o, const Ray r, double t_min, double t_max, HitRecord *rec) {
+bool Sphere_hit(HittableObject o, const Ray3 r, double t_min, double t_max, HitRecord *rec) {
 	Sphere s = o.sphere;
-	Vector3 oc = Vector3Subtract(r.position, s.center);
-	double a = Vector3LengthSqr(r.direction);
+	Vec3 oc = Vec3Subtract(r.position, s.center);
+	double a = Vec3LengthSqr(r.direction);
 	double half_b = dot(oc, r.direction);
-	double c = Vector3LengthSqr(oc) - s.radius*s.radius;
+	double c = Vec3LengthSqr(oc) - s.radius*s.radius;
 	double discriminant = half_b*half_b - a*c;
 
 	if (discriminant < 0) return false;
@@ -79,13 +82,30 @@ bool Sphere_hit(HittableObject o, const Ray r, double t_min, double t_max, HitRe
 	rec->t = t;
 	rec->p = Ray_at(r, rec->t);
 
-	Vector3 outward_normal = Vector3Scale(Vector3Subtract(rec->p, s.center), 1.0 / s.radius);
+	Vec3 outward_normal = Vec3Scale(Vec3Subtract(rec->p, s.center), 1.0 / s.radius);
 	set_face_normal(rec, r, outward_normal); // if the ray is inside the sphere the normal should be inverted
 	rec->mat_i = s.mat_i;
 
 	return true;
 }
 
+bool Sphere_occluded(HittableObject o, const Ray3 r, double t_min, double t_max) {
+	Sphere s = o.sphere;
+	Vec3 oc = Vec3Subtract(r.position, s.center);
+	double a = Vec3LengthSqr(r.direction);
+	double half_b = dot(oc, r.direction);
+	double c = Vec3LengthSqr(oc) - s.radius*s.radius;
+	double discriminant = half_b*half_b - a*c;
+
+	if (discriminant < 0) return false;
+	double sqrtd = sqrt(discriminant);
+
+	double t = (-half_b - sqrtd) / a;
+	if (t > t_min && t < t_max) return true;
+	t = (-half_b + sqrtd) / a;
+	return t > t_min && t < t_max;
+}
+
 void Sphere_print(HittableObject o, char* tab) {
 	Sphere s = o.sphere;
 	printf("Sphere (%2f, %2f, %2f) radius %2f material %d\r\n", s.center.x, s.center.y, s.center.z, s.radius, s.mat_i);
@@ -93,14 +113,48 @@ void Sphere_print(HittableObject o, char* tab) {
 
 bool Sphere_boundingbox(HittableObject o, Aabb* output_box) {
 	Sphere s = o.sphere;
-	output_box->minimum = Vector3Subtract(s.center, vec3(s.radius, s.radius, s.radius));
-	output_box->maximum = Vector3Add(s.center, vec3(s.radius, s.radius, s.radius));
+	output_box->minimum = Vec3Subtract(s.center, vec3(s.radius, s.radius, s.radius));
+	output_box->maximum = Vec3Add(s.center, vec3(s.radius, s.radius, s.radius));
 	return true;
 }
 
-Hittable MakeSphere(Vector3 center, double radius, int material) {
+// uniformly samples the cone of directions from p that hit the sphere.
+// returns false if p is inside the sphere, since then there's no cone to sample
+bool Sphere_sampleSolidAngle(Sphere s, Vec3 p, double u1, double u2, Vec3* direction, double* pdf) {
+	Vec3 to_center = Vec3Subtract(s.center, p);
+	double dist_sqr = Vec3LengthSqr(to_center);
+	if (dist_sqr <= s.radius * s.radius) return false;
+
+	double cos_theta_max = sqrt(fmax(0.0, 1.0 - s.radius * s.radius / dist_sqr));
+	double cos_theta = 1.0 - u1 * (1.0 - cos_theta_max);
+	double sin_theta = sqrt(fmax(0.0, 1.0 - cos_theta * cos_theta));
+	double phi = 2 * pi * u2;
+
+	Vec3 w = Vec3Scale(to_center, 1.0 / sqrt(dist_sqr));
+	Vec3 u, v;
+	Vec3OrthonormalBasis(w, &u, &v);
+
+	*direction = Vec3Add(
+		Vec3Add(Vec3Scale(u, cos(phi) * sin_theta), Vec3Scale(v, sin(phi) * sin_theta)),
+		Vec3Scale(w, cos_theta)
+	);
+	*pdf = 1.0 / (2 * pi * (1.0 - cos_theta_max));
+	return true;
+}
+
+// the pdf Sphere_sampleSolidAngle would have for any direction from p that hits the sphere
+double Sphere_solidAnglePdf(Sphere s, Vec3 p) {
+	double dist_sqr = Vec3LengthSqr(Vec3Subtract(s.center, p));
+	if (dist_sqr <= s.radius * s.radius) return 0;
+
+	double cos_theta_max = sqrt(fmax(0.0, 1.0 - s.radius * s.radius / dist_sqr));
+	return 1.0 / (2 * pi * (1.0 - cos_theta_max));
+}
+
+Hittable MakeSphere(Vec3 center, double radius, int material) {
 	Hittable s;
 	s.hit = Sphere_hit;
+	s.occluded = Sphere_occluded;
 	s.print = Sphere_print;
 	s.bounding_box = Sphere_boundingbox;
 	s.object.sphere = (Sphere){radius, center};
@@ -113,20 +167,15 @@ void Aabb_print(HittableObject o, char* tab) {
 	printf("AABB min (%2f, %2f, %2f) max (%2f, %2f, %2f)\r\n", a.minimum.x, a.minimum.y, a.minimum.z, a.maximum.x, a.maximum.y, a.maximum.z);
 }
 
-bool Aabb_hit(HittableObject o, const Ray r, double t_min, double t_max, HitRecord *rec) {
+bool Aabb_occluded(HittableObject o, const Ray3 r, double t_min, double t_max) {
 	Aabb a = o.aabb;
-	double min[3] = vec2arr(a.minimum);
-	double max[3] = vec2arr(a.maximum);
-
-	double r_origin[3] = vec2arr(r.position);
-	double r_direction[3] = vec2arr(r.direction);
 
 	/* // unoptimized, but more readable hit method
 	for (int i = 0; i < 3; i++) {
-		double t0 = fmin((min[i] - r_origin[i]) / r_direction[i],
-			(max[i] - r_origin[i]) / r_direction[i]);
-		double t1 = fmax((min[i] - r_origin[i]) / r_direction[i],
-			(max[i] - r_origin[i]) / r_direction[i]);
+		double t0 = fmin((a.minimum.e[i] - r.position.e[i]) / r.direction.e[i],
+			(a.maximum.e[i] - r.position.e[i]) / r.direction.e[i]);
+		double t1 = fmax((a.minimum.e[i] - r.position.e[i]) / r.direction.e[i],
+			(a.maximum.e[i] - r.position.e[i]) / r.direction.e[i]);
 
 		t_min = fmax(t0, t_min);
 		t_max = fmin(t1, t_max);
@@ -136,44 +185,32 @@ bool Aabb_hit(HittableObject o, const Ray r, double t_min, double t_max, HitReco
 	}
 	return true;
 	*/
-	for (int i = 0; i < 3; i++) {
-		double invD = 1.0f / r_direction[i];
-		double t0 = (min[i] - r_origin[i]) * invD;
-		double t1 = (max[i] - r_origin[i]) * invD;
-		if (invD < 0.0f) {
-			double tmp = t0;
-			t0 = t1;
-			t1 = tmp;
-		}
+	// all three slabs at once
+	Vec3 invD = Vec3Divide(Vec3One(), r.direction);
+	Vec3 t0 = Vec3Multiply(Vec3Subtract(a.minimum, r.position), invD);
+	Vec3 t1 = Vec3Multiply(Vec3Subtract(a.maximum, r.position), invD);
 
-		t_min = t0 > t_min ? t0 : t_min;
-		t_max = t1 < t_max ? t1 : t_max;
+	double t_enter = Vec3MaxComponent(Vec3Min(t0, t1));
+	double t_exit = Vec3MinComponent(Vec3Max(t0, t1));
 
-		if (t_max <= t_min)
-			return false;
-	}
-	return true;
-}
+	t_min = t_enter > t_min ? t_enter : t_min;
+	t_max = t_exit < t_max ? t_exit : t_max;
 
-Aabb surrounding_box(Aabb *box0, Aabb *box1) {
-	Vector3 small = {
-		fmin(box0->minimum.x, box1->minimum.x),
-		fmin(box0->minimum.y, box1->minimum.y),
-		fmin(box0->minimum.z, box1->minimum.z)
-	};
+	return t_max > t_min;
+}
 
-	Vector3 big = {
-		fmax(box0->maximum.x, box1->maximum.x),
-		fmax(box0->maximum.y, box1->maximum.y),
-		fmax(box0->maximum.z, box1->maximum.z)
-	};
+bool Aabb_hit(HittableObject o, const Ray3 r, double t_min, double t_max, HitRecord *rec) {
+	return Aabb_occluded(o, r, t_min, t_max);
+}
 
-	return (Aabb){small, big};
+Aabb surrounding_box(Aabb *box0, Aabb *box1) {
+	return (Aabb){Vec3Min(box0->minimum, box1->minimum), Vec3Max(box0->maximum, box1->maximum)};
 }
 
-Hittable MakeAabb(Vector3 minimum, Vector3 maximum) {
+Hittable MakeAabb(Vec3 minimum, Vec3 maximum) {
 	Hittable a;
 	a.hit = Aabb_hit;
+	a.occluded = Aabb_occluded;
 	a.print = Aabb_print;
 	a.object.aabb = (Aabb){minimum, maximum};
 	return a;
@@ -185,20 +222,19 @@ bool BVHNode_boundingbox(HittableObject o, Aabb* output_box) {
 }
 
 void BVHNode_print(HittableObject o, char* tab) {
-	char* new_tab = malloc((strlen(tab) + 1) * sizeof(char));
-	sprintf(new_tab, "%s\t", tab);
+	char new_tab[64]; // deeper than that and it just stops indenting
+	snprintf(new_tab, sizeof(new_tab), "%s\t", tab);
 
 	printf("BVH Node:\r\n%s\t", tab);
 	(*(Hittable*)(o.bvh_node.left)).print((*(Hittable*)(o.bvh_node.left)).object, new_tab);
 	printf("%s\t", tab);
 	(*(Hittable*)(o.bvh_node.right)).print((*(Hittable*)(o.bvh_node.right)).object, new_tab);
-	free(new_tab);
 }
 
-bool BVHNode_hit(HittableObject o, const Ray r, double t_min, double t_max, HitRecord *rec) {
+bool BVHNode_hit(HittableObject o, const Ray3 r, double t_min, double t_max, HitRecord *rec) {
 	HittableObject box;
 	box.aabb = o.bvh_node.box;
-	if(!Aabb_hit(box, r, t_min, t_max, rec))
+	if(!Aabb_occluded(box, r, t_min, t_max))
 		return false;
 
 	bool hit_left = (*(Hittable*)(o.bvh_node.left)).hit((*(Hittable*)(o.bvh_node.left)).object, r, t_min, t_max, rec);
@@ -207,6 +243,18 @@ bool BVHNode_hit(HittableObject o, const Ray r, double t_min, double t_max, HitR
 	return hit_left || hit_right;
 }
 
+bool BVHNode_occluded(HittableObject o, const Ray3 r, double t_min, double t_max) {
+	HittableObject box;
+	box.aabb = o.bvh_node.box;
+	if(!Aabb_occluded(box, r, t_min, t_max))
+		return false;
+
+	Hittable* left = (Hittable*)(o.bvh_node.left);
+	Hittable* right = (Hittable*)(o.bvh_node.right);
+	// any hit will do, so there's no need to look at the right side if the left one is blocked
+	return left->occluded(left->object, r, t_min, t_max) || right->occluded(right->object, r, t_min, t_max);
+}
+
 int box_compare(Hittable* a, Hittable *b, int axis) {
 	Aabb box_a;
 	Aabb box_b;
@@ -216,10 +264,7 @@ int box_compare(Hittable* a, Hittable *b, int axis) {
 		exit(1);
 	}
 
-	double a_min[3] = vec2arr(box_a.minimum);
-	double b_min[3] = vec2arr(box_b.minimum);
-
-	return a_min[axis] < b_min[axis] ? 1 : -1;
+	return box_a.minimum.e[axis] < box_b.minimum.e[axis] ? 1 : -1;
 }
 
 int box_x_compare(const void* a, const void* b) {
@@ -235,7 +280,8 @@ int box_z_compare(const void* a, const void* b) {
 }
 
 
-Hittable* MakeBVHNode(Hittable* objects, size_t start, size_t end) {
+// the nodes come out of arena, and the leaves point into objects, so it has to stay where it is
+Hittable* MakeBVHNode(Arena* arena, Hittable* objects, size_t start, size_t end) {
 	Hittable *left, *right;
 	size_t object_span = end - start;
 
@@ -260,8 +306,8 @@ Hittable* MakeBVHNode(Hittable* objects, size_t start, size_t end) {
 		qsort(objects + start, object_span, sizeof(Hittable), comparator);
 
 		size_t mid = start + object_span / 2;
-		left = MakeBVHNode(objects, start, mid);
-		right = MakeBVHNode(objects, mid, end);
+		left = MakeBVHNode(arena, objects, start, mid);
+		right = MakeBVHNode(arena, objects, mid, end);
 	}
 
 	Aabb box_left, box_right;
@@ -273,22 +319,23 @@ Hittable* MakeBVHNode(Hittable* objects, size_t start, size_t end) {
 
 	Aabb box = surrounding_box(&box_left, &box_right);
 
-	Hittable* b = malloc(sizeof(Hittable));
+	Hittable* b = (Hittable*)Arena_alloc(arena, sizeof(Hittable));
 	b->object.bvh_node = (BVHNode){left, right, box};
 	b->hit = BVHNode_hit;
+	b->occluded = BVHNode_occluded;
 	b->print = BVHNode_print;
 	b->bounding_box = BVHNode_boundingbox;
 
-	return b; // this can cause a memory leak if we ever need to update the BVH, so BEWARE
+	return b;
 }
 
 // material types
 typedef struct {
-	Vector3 albedo;
+	Vec3 albedo;
 } Lambertian;
 
 typedef struct {
-	Vector3 albedo;
+	Vec3 albedo;
 	float roughness;
 } Metal;
 
@@ -297,7 +344,7 @@ typedef struct {
 } Dielectric;
 
 typedef struct {
-	Vector3 color;
+	Vec3 color;
 	float brighness;
 } Emissive;
 
@@ -311,31 +358,41 @@ typedef union {
 
 struct Mat {
 	MaterialObject object;
-	bool (*scatter)(MaterialObject o, const Ray r_in, HitRecord *rec, Vector3 *attenuation, Ray *scattered);
+	// u holds three uniform random numbers in [0,1) for the material to build its scattered ray from
+	bool (*scatter)(MaterialObject o, const Ray3 r_in, HitRecord *rec, Vec3 u, Vec3 *attenuation, Ray3 *scattered);
+	// returns brdf * cos for a given unit direction and sets pdf to how likely scatter() is to pick it.
+	// NULL for materials that scatter into a single direction (mirrors, glass), which can't be light sampled
+	Vec3 (*eval)(MaterialObject o, HitRecord *rec, Vec3 direction, double *pdf);
 };
 
 // material functions
 
-bool Lambertian_scatter(MaterialObject o, const Ray r_in, HitRecord *rec, Vector3 *attenuation, Ray *scattered) {
+bool Lambertian_scatter(MaterialObject o, const Ray3 r_in, HitRecord *rec, Vec3 u, Vec3 *attenuation, Ray3 *scattered) {
 	Lambertian l = o.lambertian;
-	Vector3 scatter_direction = Vector3Add(rec->normal, random_unit_vector());
+	*scattered = ray(rec->p, to_world(sample_cosine_hemisphere(u.x, u.y), rec->normal));
+	*attenuation = l.albedo;
+	return true;
+}
 
-	if (Vector3Equals(scatter_direction, vec3(0,0,0))) {
-		scatter_direction = rec->normal;
+Vec3 Lambertian_eval(MaterialObject o, HitRecord *rec, Vec3 direction, double *pdf) {
+	Lambertian l = o.lambertian;
+	double cos_theta = dot(rec->normal, direction);
+	if (cos_theta <= 0) {
+		*pdf = 0;
+		return color(0, 0, 0);
 	}
 
-	*scattered = ray(rec->p, scatter_direction);
-	*attenuation = l.albedo;
-	return true;
+	*pdf = cos_theta / pi; // scatter() samples the cosine weighted hemisphere
+	return Vec3Scale(l.albedo, cos_theta / pi);
 }
 
-bool Metal_scatter(MaterialObject o, const Ray r_in, HitRecord *rec, Vector3 *attenuation, Ray *scattered) {
+bool Metal_scatter(MaterialObject o, const Ray3 r_in, HitRecord *rec, Vec3 u, Vec3 *attenuation, Ray3 *scattered) {
 	Metal m = o.metal;
 
-	Vector3 reflected = Vector3Reflect(UnitVector(r_in.direction), rec->normal);
-	*scattered = ray(rec->p, Vector3Add(
+	Vec3 reflected = Vec3Reflect(UnitVector(r_in.direction), rec->normal);
+	*scattered = ray(rec->p, Vec3Add(
 		reflected,
-		Vector3Scale(random_in_unit_sphere(), m.roughness)
+		Vec3Scale(sample_in_unit_sphere(u.x, u.y, u.z), m.roughness)
 	));
 
 	if (dot(scattered->direction, rec->normal) > 0) {
@@ -346,43 +403,49 @@ bool Metal_scatter(MaterialObject o, const Ray r_in, HitRecord *rec, Vector3 *at
 	return false;
 }
 
-bool Dielectric_scatter(MaterialObject o, const Ray r_in, HitRecord *rec, Vector3 *attenuation, Ray *scattered) {
+bool Dielectric_scatter(MaterialObject o, const Ray3 r_in, HitRecord *rec, Vec3 u, Vec3 *attenuation, Ray3 *scattered) {
 	Dielectric d = o.dielectric;
 
 	*attenuation = color(1.0, 1.0, 1.0);
 	double refraction_ratio = rec->front_face ? (1.0/d.ior) : d.ior;
 
-	Vector3 unit_direction = UnitVector(r_in.direction);
-	double cos_theta = fmin(dot(Vector3Negate(unit_direction), rec->normal), 1.0);
+	Vec3 unit_direction = UnitVector(r_in.direction);
+	double cos_theta = fmin(dot(Vec3Negate(unit_direction), rec->normal), 1.0);
 	double sin_theta = sqrt(1.0 - cos_theta * cos_theta);
 
 	bool cannot_refract = refraction_ratio * sin_theta > 1.0;
-	Vector3 direction;
+	Vec3 direction;
 
-	if (cannot_refract || reflectance(cos_theta, refraction_ratio) > random_double1())
-		direction = Vector3Reflect(unit_direction, rec->normal);
+	if (cannot_refract || reflectance(cos_theta, refraction_ratio) > u.x)
+		direction = Vec3Reflect(unit_direction, rec->normal);
 	else
-		direction = Vector3Refract(unit_direction, rec->normal, refraction_ratio);
+		direction = Vec3Refract(unit_direction, rec->normal, refraction_ratio);
 	*scattered = ray(rec->p, direction);
 	return true;
 }
 
-bool Emissive_scatter(MaterialObject o, const Ray r_in, HitRecord *rec, Vector3 *attenuation, Ray *scattered) {
+bool Emissive_scatter(MaterialObject o, const Ray3 r_in, HitRecord *rec, Vec3 u, Vec3 *attenuation, Ray3 *scattered) {
 	Emissive e = o.emissive;
-	*attenuation = Vector3Scale(e.color, e.brighness);
+	*attenuation = Vec3Scale(e.color, e.brighness);
 	return false;
 }
 
-Mat MakeLambertian(Vector3 albedo) {
+bool Mat_isEmissive(const Mat* m) {
+	return m->scatter == Emissive_scatter;
+}
+
+Mat MakeLambertian(Vec3 albedo) {
 	Mat s;
 	s.scatter = Lambertian_scatter;
+	s.eval = Lambertian_eval;
 	s.object.lambertian = (Lambertian){albedo};
 	return s;
 }
 
-Mat MakeMetal(Vector3 albedo, float roughness) {
+Mat MakeMetal(Vec3 albedo, float roughness) {
 	Mat s;
 	s.scatter = Metal_scatter;
+	s.eval = NULL;
 	s.object.metal = (Metal){albedo, roughness < 1 ? roughness : 1};
 	return s;
 }
@@ -390,13 +453,15 @@ Mat MakeMetal(Vector3 albedo, float roughness) {
 Mat MakeDielectric(double ior) {
 	Mat s;
 	s.scatter = Dielectric_scatter;
+	s.eval = NULL;
 	s.object.dielectric = (Dielectric){ior};
 	return s;
 }
 
-Mat MakeEmissive(Vector3 color, float brightness) {
+Mat MakeEmissive(Vec3 color, float brightness) {
 	Mat s;
 	s.scatter = Emissive_scatter;
+	s.eval = NULL;
 	s.object.emissive = (Emissive){color, brightness};
 	return s;
 }
@@ -1,82 +1,182 @@
+#define _GNU_SOURCE // for mremap, see pages.h
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include "raylib.h"
 #include "raymath.h"
 #include "utils.h"
 #include "hittable_list.h"
 #include "camera.h"
 #include "scenes.h"
+#include "sampler.h"
+#include "integrator.h"
+#include "picture.h"
+#include "render.h"
+#include "jobs.h"
+#include "denoise.h"
+#include "tonemap.h"
+#include "resolution.h"
+#include "display.h"
+#include "renderer.h"
+#include "bench.h"
+
+// the heap counters from alloc.h
+atomic_long alloc_count;
+atomic_long free_count;
+
+// shows what the render thread has so far, scaled to view (a rectangle of the window). if the camera or the size
+// changed it asks for a new image_width x image_height picture (see Renderer_restart), and shows the old one until
+// the render thread has made it. call with the renderer locked. denoiser can be NULL to show the raw samples, it's
+// run by the render thread (see Renderer_run) and shows the raw ones too until it has caught up with the picture
+void draw_image(Renderer* renderer, Denoiser* denoiser, Display* display, Tonemap tonemap, int image_width, int image_height, Rectangle view) {
+	HittableList* world = renderer->world;
+	Picture* pic = renderer->pic;
+	if (renderer->width != image_width || renderer->height != image_height || world->changed) {
+		Camera_update(&(world->camera), world->camera.origin, world->camera.lookat, world->camera.vup, world->camera.vfov, world->camera.aperture, world->camera.focus_dist, image_width, image_height);
 
-int samples_per_pixel = 1000;
-int max_bounces = 25;
-
-Vector3 ray_color(Ray r, HittableList* world, int depth) {
-	HitRecord rec;
-	if (depth <= 0) {
-		return color(0, 0, 0);
+		Renderer_restart(renderer, image_width, image_height, false);
+		world->changed = false; // acknowledge change
 	}
-	if (HittableList_hit(world, r, 0.001, INFINITY, &rec)) {
-		Ray scattered;
-		Vector3 attenuation = color(0, 0, 0);
-		if (world->materials[rec.mat_i].scatter(world->materials[rec.mat_i].object, r, &rec, &attenuation, &scattered)) {
-			return Vector3Multiply(attenuation, ray_color(scattered, world, depth - 1));
+
+	Display_update(display, pic, denoiser, tonemap, view.width, view.height);
+	Display_draw(display, view.x, view.y);
+}
+
+// tonemaps the x, y, w, h crop of the picture (top left origin, in pixels) and saves it to path
+bool save_picture(Picture* pic, Tonemap tonemap, int cx, int cy, int cw, int ch, const char* path) {
+	Vec3* row = (Vec3*)Alloc_malloc(cw * sizeof(Vec3));
+	Color* pixels = (Color*)Alloc_malloc(cw * ch * sizeof(Color));
+	for (int y = 0; y < ch; y++) {
+		int v = pic->height - 1 - (cy + y);
+		for (int x = 0; x < cw; x++) {
+			row[x] = Picture_mean(pic, cx + x, v);
 		}
-		return attenuation;
+		Tonemap_row(tonemap, row, &pixels[y * cw], cw, true);
 	}
-	// return color(0,0,0); // black sky
-	Vector3 unit_direction = UnitVector(r.direction);
-	double t = 0.5 * (unit_direction.y + 1.0f);
-	return Vector3Add(Vector3Scale(Vector3One(), 1.0f - t), Vector3Scale(color(0.5, 0.7, 1.0), t));
-}
+	Image image = {pixels, cw, ch, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+	bool saved = ExportImage(image, path);
 
-void draw_image(HittableList* world, Picture* pic) {
-	// image
-	int image_width = GetScreenWidth();
-	int image_height = GetScreenHeight();
+	Alloc_free(row);
+	Alloc_free(pixels);
+	return saved;
+}
 
-	if (pic->width != image_width || pic->height != image_height || world->changed) {
-		Picture_free(pic);
-		*pic = MakePicture(image_width, image_height);
-		Camera_update(&(world->camera), world->camera.origin, world->camera.lookat, world->camera.vup, world->camera.vfov, world->camera.aperture, world->camera.focus_dist, image_width, image_height);
-		world->changed = false; // acknowledge change
+// shift + p: the whole picture goes to render.png once it's done, as a background job on the render thread
+typedef struct {
+	Picture* pic;
+	Tonemap tonemap;
+	bool pending;
+} SaveJob;
+
+bool save_job(void* arg) {
+	SaveJob* s = (SaveJob*)arg;
+	if (save_picture(s->pic, s->tonemap, 0, 0, s->pic->width, s->pic->height, "render.png")) {
+		printf("saved the render to render.png\r\n");
 	}
+	s->pending = false;
+	return false;
+}
 
-	if (pic->sample_count < samples_per_pixel)
-		pic->sample_count++;
+// renders sexy_scene at width x height with spp samples per pixel and saves the x, y, w, h crop of it (top left
+// origin, in pixels) to path. only tiles touching the crop get traced, the rest of the picture is skipped
+int render_headless(const char* path, int width, int height, int spp, int cx, int cy, int cw, int ch) {
+	if (width < 2 || height < 2 || spp < 1 || cw < 1 || ch < 1 || cx < 0 || cy < 0 || cx + cw > width || cy + ch > height) {
+		printf("bad size or crop\r\n");
+		return 1;
+	}
 
+	HittableList world = sexy_scene();
+	Camera_update(&(world.camera), world.camera.origin, world.camera.lookat, world.camera.vup, world.camera.vfov, world.camera.aperture, world.camera.focus_dist, width, height);
+	Sampler sampler = MakeSobolSampler(1);
+	Picture pic = MakePicture(width, height);
+	pic.preview_step = 0;
+
+	int old_spp = samples_per_pixel;
+	samples_per_pixel = spp;
+	// a min_rate of 0 means tiles outside the crop never get a sample, so they're done from the start
+	render_focus = (Focus){true, cx, height - (cy + ch), cx + cw - 1, height - 1 - cy, 0, 1, 0};
+	for (int tile = 0; tile < Picture_tileCount(&pic); tile++) {
+		if (render_tileRate(&pic, tile) == 0) {
+			pic.tile_done[tile] = true;
+			pic.tiles_left--;
+		}
+	}
 
+	double start = render_now();
+	while (!render_done(&pic)) {
+		render_pass(&world, &pic, &sampler);
+	}
+	printf("rendered %dx%d of %dx%d in %.2fs, %lld samples\r\n", cw, ch, width, height, render_now() - start, pic.samples_traced);
 
-	for (int j = image_height - 1; j >= 0; j--) {
-		for (int i = 0; i < image_width; i++) {
-			if (pic->sample_count >= samples_per_pixel) {
-				DrawPixel(i, image_height - j, Vector3ToColor(Picture_at(pic, i, j), 1.0 / pic->sample_count));
-				continue;
-			}
+	bool saved = save_picture(&pic, MakeTonemap(), cx, cy, cw, ch, path);
 
-			double u = (i + random_double1()) / (image_width - 1);
-			double v = (j + random_double1()) / (image_height - 1);
+	Picture_free(&pic);
+	Sampler_free(&sampler);
+	HittableList_free(&world);
+	samples_per_pixel = old_spp;
+	render_focus.active = false;
+	return saved ? 0 : 1;
+}
 
-			Ray r = Camera_getRay(world->camera, u, v);
+int main(int argc, char** argv) {
+	Jobs_init(Jobs_cpuCount() - 1);
 
-			Vector3 color = ray_color(r, world, max_bounces);
+	// --huge-pages at the end of any of the below puts the scene and the picture on huge pages (see pages.h)
+	if (argc > 1 && strcmp(argv[argc - 1], "--huge-pages") == 0) {
+		huge_pages = true;
+		argc--;
+	}
 
-			if (pic->sample_count > 1)
-				color = Vector3Add(color, Picture_at(pic, i, j));
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+		bench_vec3();
+		bench_occlusion();
+		bench_samplers();
+		bench_adaptive();
+		bench_framebuffer();
+		bench_resolve();
+		bench_preview();
+		bench_upscale();
+		bench_budget();
+		bench_denoise();
+		bench_reprojection();
+		bench_interleave();
+		bench_focus();
+		bench_cancel();
+		bench_scene();
+		bench_hugePages();
+		// the one that can fail: the render loop should stop allocating and freeing once it's warmed up
+		long allocations = bench_allocations();
+		Jobs_shutdown();
+		return allocations == 0 ? 0 : 1;
+	}
 
-			Picture_set(pic, i, j, color);
+	// --render out.png [width height spp [x y w h]], without a window
+	if (argc > 2 && strcmp(argv[1], "--render") == 0) {
+		int width = argc > 4 ? atoi(argv[3]) : 640;
+		int height = argc > 4 ? atoi(argv[4]) : 480;
+		int spp = argc > 5 ? atoi(argv[5]) : 64;
+		bool crop = argc > 9;
+		int status = render_headless(argv[2], width, height, spp, crop ? atoi(argv[6]) : 0, crop ? atoi(argv[7]) : 0, crop ? atoi(argv[8]) : width, crop ? atoi(argv[9]) : height);
+		Jobs_shutdown();
+		return status;
+	}
 
-			DrawPixel(i, image_height - j, Vector3ToColor(color, 1.0 / pic->sample_count));
-		}
+	// ./raytracer [width height]: the picture is always rendered at this size (smaller while the camera moves),
+	// whatever size the window is, so resizing it doesn't throw away any samples. the window starts out the same
+	int full_width = argc > 2 ? atoi(argv[1]) : 640;
+	int full_height = argc > 2 ? atoi(argv[2]) : 480;
+	if (full_width < 2 || full_height < 2) {
+		printf("bad size\r\n");
+		return 1;
 	}
-}
 
-int main() {
 	printf("balls\r\n");
 	SetConfigFlags(FLAG_WINDOW_RESIZABLE);
-	InitWindow(640, 480, "Hello World!!");
+	InitWindow(full_width, full_height, "Hello World!!");
 
-	SetTargetFPS(60);
+	int target_fps = 60;
+	SetTargetFPS(target_fps);
 
 	srand(time(NULL));
 
@@ -85,16 +185,104 @@ int main() {
 
 	HittableList world = sexy_scene();
 
-	printf("got world!\r\n");
+	printf("got world!\r\n BVH:\r\n");
+	BVHNode_print(world.first_child->object, "");
 
+	// the picture being rendered, and the one before it, whose buffers the next one gets (see render_restart)
 	Picture pic = MakePicture(0, 0);
+	Picture spare = MakePicture(0, 0);
+
+	// tab cycles through these
+	uint32_t seed = rand();
+	Sampler samplers[] = {
+		MakeSobolSampler(seed),
+		MakeBlueNoiseSampler(seed),
+		MakeStratifiedSampler(seed, samples_per_pixel),
+		MakeRandomSampler(seed)
+	};
+	int sampler_count = sizeof(samplers) / sizeof(Sampler);
+	int sampler_i = 0;
+
+	// n toggles the denoiser
+	Denoiser denoiser = MakeDenoiser();
+	bool denoising = false;
+
+	Display display = MakeDisplay();
+
+	// [ and ] change the exposure by half a stop, m cycles through tonemap operators
+	Tonemap tonemap = MakeTonemap();
+
+	// renders smaller while the camera moves, so it keeps up with target_fps
+	ResolutionController resolution = MakeResolutionController(target_fps);
+
+	// once the picture is done nothing on screen changes until there's input, so instead of redrawing the
+	// same texture 60 times a second EndDrawing sleeps until an event comes in
+	bool idle = false;
+
+	// f toggles foveated sampling around the mouse. dragging with the left button focuses on a rectangle instead,
+	// right click goes back to following the cursor
+	bool focus_rect = false;
+	Vector2 drag_start = {0}, drag_end = {0};
+	Focus focus = render_focus;
+
+	// tracing happens on its own thread, in slices of half a frame between which the ui can get at the picture
+	Renderer renderer = MakeRenderer(&world, &pic, &spare, &samplers[sampler_i], 0.5 / target_fps);
+	Renderer_start(&renderer);
+	SaveJob save = {&pic};
 
 	while (!WindowShouldClose()) {
-		bool screenshotting = IsKeyReleased(80);
+		// where the picture goes in the window
+		Rectangle view = Display_fit(full_width, full_height, GetScreenWidth(), GetScreenHeight());
+
+		bool saving = IsKeyReleased(KEY_P) && IsKeyDown(KEY_LEFT_SHIFT);
+		bool screenshotting = IsKeyReleased(KEY_P) && !saving;
+
+		if (IsKeyPressed(KEY_LEFT_BRACKET)) {
+			tonemap.exposure -= 0.5f;
+		}
+		if (IsKeyPressed(KEY_RIGHT_BRACKET)) {
+			tonemap.exposure += 0.5f;
+		}
+		if (IsKeyPressed(KEY_M)) {
+			tonemap.op = (tonemap.op + 1) % TONEMAP_COUNT;
+		}
+
+		if (IsKeyPressed(KEY_F)) {
+			focus.active = !focus.active;
+			focus_rect = false;
+		}
+		if (focus.active) {
+			Vector2 mouse = GetMousePosition();
+			if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
+				focus_rect = true;
+				drag_start = mouse;
+			}
+			if (IsMouseButtonDown(MOUSE_BUTTON_LEFT)) {
+				drag_end = mouse;
+			}
+			if (IsMouseButtonPressed(MOUSE_BUTTON_RIGHT)) {
+				focus_rect = false;
+			}
+			Vector2 a = focus_rect ? drag_start : mouse;
+			Vector2 b = focus_rect ? drag_end : mouse;
+
+			// the picture is scaled to fit the window, more so while moving, and its v goes up, so convert every frame.
+			// the render thread can be replacing pic right now, but it's going to be the size asked for last
+			float sx = renderer.width / view.width;
+			float sy = renderer.height / view.height;
+			focus.x0 = (fminf(a.x, b.x) - view.x) * sx;
+			focus.x1 = (fmaxf(a.x, b.x) - view.x) * sx;
+			focus.y0 = renderer.height - (fmaxf(a.y, b.y) - view.y) * sy;
+			focus.y1 = renderer.height - (fminf(a.y, b.y) - view.y) * sy;
+			focus.radius = focus_rect ? 0 : 0.1f * renderer.height;
+			focus.falloff = 0.1f * renderer.height;
+		}
+
+		bool new_sampler = IsKeyPressed(KEY_TAB);
 
 		// camera movement
 		// wasd + q for up and z for down
-		Vector3 camera_delta = vec3(0,0,0);
+		Vec3 camera_delta = vec3(0,0,0);
 		if (IsKeyDown(KEY_W)) {
 			camera_delta.z -= 0.1;
 		}
@@ -114,7 +302,7 @@ int main() {
 			camera_delta.y -= 0.1;
 		}
 
-		Vector3 camera_lookat_delta = vec3(0, 0, 0);
+		Vec3 camera_lookat_delta = vec3(0, 0, 0);
 		// arrow keys
 		if (IsKeyDown(KEY_DOWN)) {
 			camera_lookat_delta.y -= 0.1;
@@ -156,25 +344,55 @@ int main() {
 			focusdist_delta += 0.1;
 		}
 
-		Vector3 camera_movement_vector = Vector3Add(
-			Vector3Add(
-				Vector3Scale((Vector3){world.camera.w.x, 0, world.camera.w.z}, camera_delta.z),
-				Vector3Scale((Vector3){world.camera.u.x, 0, world.camera.u.z}, camera_delta.x)),
+		Vec3 camera_movement_vector = Vec3Add(
+			Vec3Add(
+				Vec3Scale(vec3(world.camera.w.x, 0, world.camera.w.z), camera_delta.z),
+				Vec3Scale(vec3(world.camera.u.x, 0, world.camera.u.z), camera_delta.x)),
 				vec3(0, camera_delta.y, 0)
 		);
 
-		camera_lookat_delta = Vector3Add(
-			Vector3Add(
-				Vector3Scale(world.camera.w, camera_lookat_delta.z),
-				Vector3Scale(world.camera.u, camera_lookat_delta.x)),
-				Vector3Scale(world.camera.v, camera_lookat_delta.y)
+		camera_lookat_delta = Vec3Add(
+			Vec3Add(
+				Vec3Scale(world.camera.w, camera_lookat_delta.z),
+				Vec3Scale(world.camera.u, camera_lookat_delta.x)),
+				Vec3Scale(world.camera.v, camera_lookat_delta.y)
 		);
-		camera_lookat_delta = Vector3Add(camera_movement_vector, camera_lookat_delta);
-		if (Vector3Length(camera_delta) != 0 || Vector3Length(camera_lookat_delta) != 0 || fov_delta != 0 || aperture_delta != 0 || focusdist_delta != 0) {
+		camera_lookat_delta = Vec3Add(camera_movement_vector, camera_lookat_delta);
+		bool moved = Vec3Length(camera_delta) != 0 || Vec3Length(camera_lookat_delta) != 0 || fov_delta != 0 || aperture_delta != 0 || focusdist_delta != 0;
+
+		int render_width, render_height;
+		Resolution_size(&resolution, moved, full_width, full_height, &render_width, &render_height);
+
+		// whatever is being traced for the current picture is wasted once it gets replaced, so don't wait for it
+		double frame_start = GetTime();
+		bool replacing = moved || new_sampler || render_width != renderer.width || render_height != renderer.height;
+		Renderer_lock(&renderer, replacing);
+
+		if (IsKeyPressed(KEY_N)) {
+			denoising = !denoising;
+			Denoiser_invalidate(&denoiser);
+			renderer.denoiser = denoising ? &denoiser : NULL;
+		}
+
+		// a new sampler starts from scratch, so there's nothing to reproject
+		if (new_sampler) {
+			sampler_i = (sampler_i + 1) % sampler_count;
+			renderer.sampler = &samplers[sampler_i];
+			Renderer_restart(&renderer, render_width, render_height, true);
+		}
+
+		render_focus = focus;
+
+		if (saving && !save.pending) {
+			save.tonemap = tonemap;
+			save.pending = Renderer_background(&renderer, save_job, &save);
+		}
+
+		if (moved) {
 			Camera_update(
 				&(world.camera),
-				Vector3Add(world.camera.origin, camera_movement_vector),
-				Vector3Add(world.camera.lookat, camera_lookat_delta),
+				Vec3Add(world.camera.origin, camera_movement_vector),
+				Vec3Add(world.camera.lookat, camera_lookat_delta),
 				world.camera.vup,
 				world.camera.vfov + fov_delta,
 				world.camera.aperture + aperture_delta,
@@ -184,30 +402,89 @@ int main() {
 			world.changed = true;
 		}
 
-		printf("rendering sample %d\r\n", pic.sample_count + 1);
-
 		BeginDrawing();
 			ClearBackground(BLACK);
-			draw_image(&world, &pic);
+			draw_image(&renderer, denoising ? &denoiser : NULL, &display, tonemap, render_width, render_height, view);
+			if (moved) {
+				// the frame's own work, plus what the render thread needs for the coarsest preview of the new view:
+				// making the new picture, then tracing the preview's first step
+				double preview = renderer.restart_time + render_sample_time * render_width * render_height / (preview_stride * preview_stride);
+				Resolution_update(&resolution, GetTime() - frame_start + preview);
+			}
 
 			if (!screenshotting) {
 				DrawFPS(10, 10);
-				char sample[ndigits(pic.sample_count) + 7];
+				char sample[64];
 				sprintf(sample, "sample %d", pic.sample_count);
 				DrawText(sample, 10, 30, 20, WHITE);
+				DrawText(samplers[sampler_i].name, 10, 70, 20, WHITE);
+				if (denoising) {
+					DrawText("denoised", 10, 90, 20, WHITE);
+				}
+				char exposure[64];
+				sprintf(exposure, "exposure %+.1f, %s", tonemap.exposure, tonemap_names[tonemap.op]);
+				DrawText(exposure, 10, 110, 20, WHITE);
+				if (pic.width != full_width) {
+					char scale[64];
+					sprintf(scale, "rendering at %dx%d", pic.width, pic.height);
+					DrawText(scale, 10, 130, 20, WHITE);
+				}
+
+				if (focus.active) {
+					DrawText(focus_rect ? "focus: rectangle" : "focus: cursor", 10, 150, 20, WHITE);
+					if (focus_rect) {
+						DrawRectangleLines(fminf(drag_start.x, drag_end.x), fminf(drag_start.y, drag_end.y), fabsf(drag_end.x - drag_start.x), fabsf(drag_end.y - drag_start.y), YELLOW);
+					}
+					else {
+						Vector2 mouse = GetMousePosition();
+						DrawCircleLines(mouse.x, mouse.y, 0.1f * view.height, YELLOW);
+					}
+				}
+
+				if (save.pending) {
+					DrawText("saving to render.png when done", 10, 170, 20, WHITE);
+				}
 
-				if (pic.sample_count >= samples_per_pixel) {
+				if (render_done(&pic)) {
 					DrawText("rendering done!", 10, 50, 20, DARKGREEN);
 				}
 			}
+			// nothing left for the render thread to do that would change what's on screen: the picture it was asked
+			// for has been made and is done, and so are the save and the denoiser
+			bool done = render_done(&pic) && !renderer.restart && !save.pending && !(denoising && Denoiser_pending(&denoiser, &pic));
+			Renderer_unlock(&renderer);
 
 		EndDrawing();
 
 		if (screenshotting) {
 			TakeScreenshot("render.png");
 		}
+
+		// the screenshot frame is drawn without the overlay, so draw one more before going to sleep
+		bool converged = done && !screenshotting;
+		if (converged != idle) {
+			idle = converged;
+			if (idle) {
+				EnableEventWaiting();
+			}
+			else {
+				DisableEventWaiting();
+			}
+		}
 	}
+	Renderer_stop(&renderer);
+	Display_free(&display);
 	CloseWindow();
 
+	Denoiser_free(&denoiser);
+	Picture_free(&pic);
+	Picture_free(&spare);
+	HittableList_free(&world);
+	Jobs_shutdown();
+
+	for (int i = 0; i < sampler_count; i++) {
+		Sampler_free(&samplers[i]);
+	}
+
 	return 0;
 }